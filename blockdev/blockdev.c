@@ -0,0 +1,175 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#include <stdint.h>
+#include <string.h>
+#include "blockdev.h"
+
+
+//------------------------------------------------------------------------------
+// Memory backend
+//
+// Used for memory-mapped flash and for RAM-disks, e.g. an image put in DDR by
+// a debugger. The caller uses the blocks as soon as this returns, so the copy
+// stays on the CPU; handing it to the DMA engine would only spin hart 0.
+
+static int read_memory_blocks(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks)
+{
+  memcpy(dst, dev->mmap_base + lba * dev->block_size, num_blocks * dev->block_size);
+  return 0;
+}
+
+
+void blockdev_init_memory(blockdev* dev, const void* base, uint32_t block_size, uint64_t num_blocks)
+{
+  dev->block_size = block_size;
+  dev->caps = BLOCKDEV_CAP_MMAP;
+  dev->num_blocks = num_blocks;
+  dev->read_blocks = read_memory_blocks;
+  dev->read_stream = NULL;
+  dev->mmap_base = (const uint8_t*) base;
+  dev->priv = NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// Reads
+
+/**
+ * Read blocks, calling on_block for each as it becomes available. Devices that
+ * can't stream are read a block at a time.
+ */
+int blockdev_read_stream(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks,
+                         blockdev_block_fn on_block, void* ctx)
+{
+  if (dev->caps & BLOCKDEV_CAP_STREAM) {
+    return dev->read_stream(dev, dst, lba, num_blocks, on_block, ctx);
+  }
+  uint8_t* p = (uint8_t*) dst;
+  for (size_t i = 0; i < num_blocks; i++, p += dev->block_size) {
+    int error = dev->read_blocks(dev, p, lba + i, 1);
+    if (error) return error;
+    if (on_block(ctx, i, p) == BLOCKDEV_BLOCK_STOP) break;
+  }
+  return 0;
+}
+
+
+void blockdev_cache_init(blockdev_cache* cache, blockdev* dev, void* buf, size_t size)
+{
+  cache->dev = dev;
+  cache->buf = (uint8_t*) buf;
+  cache->size = size;
+  cache->first_lba = 0;
+  cache->num_valid = 0;
+}
+
+
+static int cache_fill(blockdev_cache* cache, uint64_t lba, size_t n, const uint8_t** data)
+{
+  blockdev* dev = cache->dev;
+  if (dev->num_blocks && lba >= dev->num_blocks) {
+    return BLOCKDEV_ERROR_RANGE;
+  }
+  if (lba < cache->first_lba || lba >= cache->first_lba + cache->num_valid) {
+    if (dev->num_blocks && lba + n > dev->num_blocks) {
+      n = dev->num_blocks - lba;
+    }
+    cache->num_valid = 0;
+    int error = dev->read_blocks(dev, cache->buf, lba, n);
+    if (error) return error;
+    cache->first_lba = lba;
+    cache->num_valid = n;
+  }
+  *data = cache->buf + (lba - cache->first_lba) * dev->block_size;
+  return 0;
+}
+
+
+/**
+ * Point *data at a cached copy of a block, reading it and the blocks after it
+ * if it isn't cached yet. On a device of unknown size a read-ahead that runs
+ * off the end fails like any other read.
+ */
+int blockdev_cache_get(blockdev_cache* cache, uint64_t lba, const uint8_t** data)
+{
+  return cache_fill(cache, lba, cache->size, data);
+}
+
+
+/**
+ * Like blockdev_cache_get() but without read-ahead, for a block whose
+ * neighbours are known not to be wanted, e.g. a GPT header. On SD a single
+ * block is a plain CMD17 instead of a multi-block read.
+ */
+int blockdev_cache_get_single(blockdev_cache* cache, uint64_t lba, const uint8_t** data)
+{
+  return cache_fill(cache, lba, 1, data);
+}
+
+
+/**
+ * Read blocks to dst, taking any leading blocks already in the cache from
+ * there and the rest straight from the device.
+ */
+int blockdev_read(blockdev_cache* cache, void* dst, uint64_t lba, size_t num_blocks)
+{
+  blockdev* dev = cache->dev;
+  uint8_t* p = (uint8_t*) dst;
+  if (lba >= cache->first_lba && lba < cache->first_lba + cache->num_valid) {
+    size_t n = cache->first_lba + cache->num_valid - lba;
+    if (n > num_blocks) n = num_blocks;
+    memcpy(p, cache->buf + (lba - cache->first_lba) * dev->block_size, n * dev->block_size);
+    p += n * dev->block_size;
+    lba += n;
+    num_blocks -= n;
+  }
+  if (num_blocks == 0) return 0;
+  if (dev->num_blocks && (lba >= dev->num_blocks || num_blocks > dev->num_blocks - lba)) {
+    return BLOCKDEV_ERROR_RANGE;
+  }
+  return dev->read_blocks(dev, p, lba, num_blocks);
+}
+
+
+/**
+ * Read an arbitrary byte range. Partial blocks at either end go through the
+ * cache.
+ */
+int blockdev_read_bytes(blockdev_cache* cache, void* dst, uint64_t offset, uint64_t len)
+{
+  blockdev* dev = cache->dev;
+  uint32_t bs = dev->block_size;
+  uint8_t* p = (uint8_t*) dst;
+  uint64_t lba = offset / bs;
+  size_t skip = offset % bs;
+  const uint8_t* data;
+  int error;
+
+  if (skip && len) {
+    size_t n = bs - skip;
+    if (n > len) n = len;
+    error = blockdev_cache_get(cache, lba, &data);
+    if (error) return error;
+    memcpy(p, data + skip, n);
+    p += n;
+    len -= n;
+    lba++;
+  }
+  uint64_t num_blocks = len / bs;
+  if (num_blocks) {
+    error = blockdev_read(cache, p, lba, num_blocks);
+    if (error) return error;
+    p += num_blocks * bs;
+    len -= num_blocks * bs;
+    lba += num_blocks;
+  }
+  if (len) {
+    error = blockdev_cache_get(cache, lba, &data);
+    if (error) return error;
+    memcpy(p, data, len);
+  }
+  return 0;
+}
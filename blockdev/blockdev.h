@@ -0,0 +1,76 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _LIBRARIES_BLOCKDEV_H
+#define _LIBRARIES_BLOCKDEV_H
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// read_stream hands over blocks as they arrive rather than all at the end
+#define BLOCKDEV_CAP_STREAM (1 << 0)
+// Contents can be read in place at mmap_base
+#define BLOCKDEV_CAP_MMAP (1 << 1)
+
+// Errors raised by the block layer itself. They are negative so they can't be
+// mistaken for a backend's codes, which are positive.
+#define BLOCKDEV_ERROR_RANGE (-1)  // Read past num_blocks
+
+// Return values of blockdev_block_fn
+#define BLOCKDEV_BLOCK_CONTINUE 0
+#define BLOCKDEV_BLOCK_STOP 1
+
+// Called for each block of a streamed read once it is in dst and known good.
+// block is the index within the read.
+typedef int (*blockdev_block_fn)(void* ctx, size_t block, const void* data);
+
+typedef struct blockdev blockdev;
+
+/**
+ * A bulk storage medium read in fixed-size blocks. The read functions return
+ * 0 or a positive error code of the backend's choosing.
+ */
+struct blockdev
+{
+  uint32_t block_size;
+  uint32_t caps;
+  uint64_t num_blocks;  // 0 if unknown
+  int (*read_blocks)(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks);
+  // Only with BLOCKDEV_CAP_STREAM
+  int (*read_stream)(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks,
+                     blockdev_block_fn on_block, void* ctx);
+  const uint8_t* mmap_base;  // Only with BLOCKDEV_CAP_MMAP
+  void* priv;
+};
+
+/**
+ * Small read-ahead cache of consecutive blocks. Sub-block and single-block
+ * reads fill it with the blocks that follow, and bulk reads take any leading
+ * blocks they can from it before going to the device.
+ */
+typedef struct
+{
+  blockdev* dev;
+  uint8_t* buf;
+  size_t size;        // blocks buf can hold
+  uint64_t first_lba;
+  size_t num_valid;
+} blockdev_cache;
+
+void blockdev_init_memory(blockdev* dev, const void* base, uint32_t block_size, uint64_t num_blocks);
+int blockdev_read_stream(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks,
+                         blockdev_block_fn on_block, void* ctx);
+
+void blockdev_cache_init(blockdev_cache* cache, blockdev* dev, void* buf, size_t size);
+int blockdev_cache_get(blockdev_cache* cache, uint64_t lba, const uint8_t** data);
+int blockdev_cache_get_single(blockdev_cache* cache, uint64_t lba, const uint8_t** data);
+int blockdev_read(blockdev_cache* cache, void* dst, uint64_t lba, size_t num_blocks);
+int blockdev_read_bytes(blockdev_cache* cache, void* dst, uint64_t offset, uint64_t len);
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _LIBRARIES_BLOCKDEV_H */
@@ -0,0 +1,88 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#include <stdint.h>
+#include "clkutils.h"
+
+#define NS_PER_SEC 1000000000UL
+
+// everything zero is correct initial state: uncalibrated
+static struct {
+  uint64_t hz;          // mcycle rate
+  uint64_t base_cycle;  // mcycle at base_ns
+  uint64_t base_ns;
+} clk;
+
+
+// cycles * NS_PER_SEC / hz without overflowing for long intervals
+static uint64_t cycles_to_ns(uint64_t cycles, uint64_t hz)
+{
+  return cycles / hz * NS_PER_SEC + cycles % hz * NS_PER_SEC / hz;
+}
+
+
+/**
+ * Measure the mcycle rate against mtime.
+ *
+ * Starts on an mtime edge so the measurement covers whole ticks, and takes
+ * CLKUTILS_CALIBRATE_TICKS ticks. The ns clock is rebased on mtime without
+ * ever going backwards.
+ */
+void clkutils_calibrate(void)
+{
+  uint64_t t0 = clkutils_read_mtime();
+  uint64_t t;
+  while ((t = clkutils_read_mtime()) == t0) ;
+  uint64_t c0 = clkutils_read_mcycle();
+  while (clkutils_read_mtime() < t + CLKUTILS_CALIBRATE_TICKS) ;
+  uint64_t c1 = clkutils_read_mcycle();
+
+  uint64_t old_ns = clkutils_read_ns();
+  uint64_t mtime_ns = (t + CLKUTILS_CALIBRATE_TICKS) * RTC_PERIOD_NS;
+  clk.hz = (c1 - c0) * RTC_FREQUENCY_HZ / CLKUTILS_CALIBRATE_TICKS;
+  clk.base_cycle = c1;
+  clk.base_ns = mtime_ns > old_ns ? mtime_ns : old_ns;
+}
+
+
+/**
+ * Core clock rate found by the last clkutils_calibrate(), 0 if none.
+ */
+uint64_t clkutils_core_hz(void)
+{
+  return clk.hz;
+}
+
+
+/**
+ * Monotonic nanoseconds since reset, at mcycle resolution once calibrated.
+ */
+uint64_t clkutils_read_ns(void)
+{
+  if (!clk.hz) {
+    return clkutils_read_mtime() * RTC_PERIOD_NS;
+  }
+  return clk.base_ns + cycles_to_ns(clkutils_read_mcycle() - clk.base_cycle, clk.hz);
+}
+
+
+/**
+ * Delay at least delay_ns, to within a few cycles once calibrated.
+ */
+void clkutils_ndelay(uint64_t delay_ns)
+{
+  if (!clk.hz) {
+    // clkutils_delay_ns() takes an int
+    for (; delay_ns > NS_PER_SEC; delay_ns -= NS_PER_SEC) {
+      clkutils_delay_ns(NS_PER_SEC);
+    }
+    clkutils_delay_ns(delay_ns);
+    return;
+  }
+  uint64_t cycles =
+    delay_ns / NS_PER_SEC * clk.hz + (delay_ns % NS_PER_SEC * clk.hz + NS_PER_SEC - 1) / NS_PER_SEC;
+  uint64_t start = clkutils_read_mcycle();
+  while (clkutils_read_mcycle() - start < cycles) ;
+}
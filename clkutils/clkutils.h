@@ -69,6 +69,19 @@ inline void clkutils_delay_ns(int delay_ns) {
   while (now < then);
 }
 
+// Calibrated timekeeping (clkutils/calibrate.c, fsbl only). mcycle is
+// measured against mtime by clkutils_calibrate(), which has to be called
+// again after every core PLL change. Until then these fall back to mtime.
+// mcycle is per hart, so the calibration only holds on the hart that ran it.
+
+// mtime ticks clkutils_calibrate() measures over
+#define CLKUTILS_CALIBRATE_TICKS 128
+
+void clkutils_calibrate(void);
+uint64_t clkutils_core_hz(void);
+uint64_t clkutils_read_ns(void);
+void clkutils_ndelay(uint64_t delay_ns);
+
 #endif /* !__ASSEMBLER__ */
 
 #endif /* _LIBRARIES_CLKUTILS_H */
@@ -0,0 +1,67 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#include <stdint.h>
+#include <sifive/platform.h>
+#include "dma.h"
+
+#define DMA_CH_REG(ch, offset) _REG32(DMA_CHANNEL_ADDR(ch), offset)
+#define DMA_CH_REG64(ch, offset) _REG64(DMA_CHANNEL_ADDR(ch), offset)
+
+
+/**
+ * Claim a channel and start copying len bytes from src to dst on it. Returns
+ * without waiting; use dma_poll() or dma_wait() to find out when it is done.
+ */
+int dma_submit(int channel, void* dst, const void* src, size_t len)
+{
+  if (DMA_CH_REG(channel, DMA_CONTROL) & DMA_CONTROL_CLAIM) {
+    return DMA_ERROR_CLAIMED;
+  }
+  DMA_CH_REG(channel, DMA_CONTROL) = DMA_CONTROL_CLAIM;
+  DMA_CH_REG64(channel, DMA_NEXT_BYTES) = len;
+  DMA_CH_REG64(channel, DMA_NEXT_DEST) = (uintptr_t) dst;
+  DMA_CH_REG64(channel, DMA_NEXT_SRC) = (uintptr_t) src;
+  DMA_CH_REG(channel, DMA_NEXT_CONFIG) = DMA_NEXT_CONFIG_FULL_SPEED;
+  // Make the CPU's stores to src visible before the engine reads it
+  __asm__ __volatile__ ("fence w, o" : : : "memory");
+  DMA_CH_REG(channel, DMA_CONTROL) = DMA_CONTROL_CLAIM | DMA_CONTROL_RUN;
+  return 0;
+}
+
+
+/**
+ * Start zeroing up to CACHEABLE_ZERO_MEM_SIZE bytes by copying from the
+ * cacheable zero region.
+ */
+int dma_submit_zero(int channel, void* dst, size_t len)
+{
+  return dma_submit(channel, dst, (const void*) CACHEABLE_ZERO_MEM_ADDR, len);
+}
+
+
+/**
+ * Check on a transfer. Once it has finished, the channel is released and the
+ * result is 0 or DMA_ERROR_TRANSFER; until then it is DMA_BUSY.
+ */
+int dma_poll(int channel)
+{
+  uint32_t control = DMA_CH_REG(channel, DMA_CONTROL);
+  if (control & DMA_CONTROL_RUN) {
+    return DMA_BUSY;
+  }
+  DMA_CH_REG(channel, DMA_CONTROL) = 0;
+  __asm__ __volatile__ ("fence i, r" : : : "memory");
+  return (control & DMA_CONTROL_ERROR) ? DMA_ERROR_TRANSFER : 0;
+}
+
+
+int dma_wait(int channel)
+{
+  int rc;
+  while ((rc = dma_poll(channel)) == DMA_BUSY) ;
+  return rc;
+}
+
@@ -0,0 +1,53 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _LIBRARIES_DMA_H
+#define _LIBRARIES_DMA_H
+
+#include <sifive/platform.h>
+
+#define DMA_NUM_CHANNELS 4
+#define DMA_CHANNEL_ADDR(ch) (DMA_CTRL_ADDR + 0x80000 + (ch) * 0x1000)
+
+// Channel register offsets
+#define DMA_CONTROL 0x000
+#define DMA_NEXT_CONFIG 0x004
+#define DMA_NEXT_BYTES 0x008
+#define DMA_NEXT_DEST 0x010
+#define DMA_NEXT_SRC 0x018
+
+#define DMA_CONTROL_CLAIM (1 << 0)
+#define DMA_CONTROL_RUN (1 << 1)
+#define DMA_CONTROL_DONE (1 << 30)
+#define DMA_CONTROL_ERROR (1U << 31)
+
+// Largest read and write transaction sizes: full speed copy
+#define DMA_NEXT_CONFIG_FULL_SPEED 0xff000000
+
+// Channel hart 0 uses for boot-time copies
+#define DMA_CHANNEL_BOOT 0
+// Channel the loader clears .bss on while it reads the next segment
+#define DMA_CHANNEL_CLEAR 1
+// Copies shorter than this are left to the CPU
+#define DMA_MIN_BYTES 4096
+
+// dma_poll() results besides 0 (done)
+#define DMA_BUSY 1
+#define DMA_ERROR_TRANSFER 2
+// dma_submit() result if the channel is still in use
+#define DMA_ERROR_CLAIMED 3
+
+#ifndef __ASSEMBLER__
+
+#include <stddef.h>
+
+int dma_submit(int channel, void* dst, const void* src, size_t len);
+int dma_submit_zero(int channel, void* dst, size_t len);
+int dma_poll(int channel);
+int dma_wait(int channel);
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _LIBRARIES_DMA_H */
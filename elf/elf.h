@@ -0,0 +1,72 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _LIBRARIES_ELF_H
+#define _LIBRARIES_ELF_H
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// e_ident[0..3] read as a little-endian word
+#define ELF_MAGIC 0x464c457fU
+#define ELF_CLASS_64 2
+#define ELF_DATA_LSB 1
+#define ELF_TYPE_EXEC 2
+#define ELF_MACHINE_RISCV 243
+#define ELF_PT_LOAD 1
+
+typedef struct
+{
+  uint8_t e_ident[16];
+  uint16_t e_type;
+  uint16_t e_machine;
+  uint32_t e_version;
+  uint64_t e_entry;
+  uint64_t e_phoff;
+  uint64_t e_shoff;
+  uint32_t e_flags;
+  uint16_t e_ehsize;
+  uint16_t e_phentsize;
+  uint16_t e_phnum;
+  uint16_t e_shentsize;
+  uint16_t e_shnum;
+  uint16_t e_shstrndx;
+} elf64_ehdr;
+
+typedef struct
+{
+  uint32_t p_type;
+  uint32_t p_flags;
+  uint64_t p_offset;
+  uint64_t p_vaddr;
+  uint64_t p_paddr;
+  uint64_t p_filesz;
+  uint64_t p_memsz;
+  uint64_t p_align;
+} elf64_phdr;
+
+#define _ASSERT_SIZEOF(type, size) \
+  _Static_assert(sizeof(type) == (size), #type " must be " #size " bytes wide")
+_ASSERT_SIZEOF(elf64_ehdr, 64);
+_ASSERT_SIZEOF(elf64_phdr, 56);
+#undef _ASSERT_SIZEOF
+
+static inline int elf_is_riscv64_exec(const elf64_ehdr* ehdr)
+{
+  uint32_t magic;
+  __builtin_memcpy(&magic, ehdr->e_ident, sizeof(magic));
+  return magic == ELF_MAGIC &&
+    ehdr->e_ident[4] == ELF_CLASS_64 &&
+    ehdr->e_ident[5] == ELF_DATA_LSB &&
+    ehdr->e_type == ELF_TYPE_EXEC &&
+    ehdr->e_machine == ELF_MACHINE_RISCV &&
+    ehdr->e_phentsize == sizeof(elf64_phdr);
+}
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _LIBRARIES_ELF_H */
@@ -10,25 +10,32 @@
 
 #define max(x, y) ( x > y ? x : y)
 
-void ememory_otp_power_up_sequence()
+// Everything in the power up sequence but the final TTAS wait, which the
+// caller has to leave before the first access.
+void ememory_otp_power_up_begin()
 {
   // Probably don't need to do this, since
   // all the other stuff has been happening.
   // But it is on the wave form.
-  clkutils_delay_ns(EMEMORYOTP_MIN_TVDS * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TVDS * 1000);
 
   EMEMORYOTP_REG(EMEMORYOTP_PDSTB) = 1;
-  clkutils_delay_ns(EMEMORYOTP_MIN_TSAS * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TSAS * 1000);
 
   EMEMORYOTP_REG(EMEMORYOTP_PTRIM) = 1;
-  clkutils_delay_ns(EMEMORYOTP_MIN_TTAS * 1000);
+}
+
+void ememory_otp_power_up_sequence()
+{
+  ememory_otp_power_up_begin();
+  clkutils_ndelay(EMEMORYOTP_MIN_TTAS * 1000);
 }
 
 void ememory_otp_power_down_sequence()
 {
-  clkutils_delay_ns(EMEMORYOTP_MIN_TTAH * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TTAH * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PTRIM) = 0;
-  clkutils_delay_ns(EMEMORYOTP_MIN_TASH * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TASH * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PDSTB) = 0;
   // No delay indicated after this
 }
@@ -41,12 +48,12 @@ void ememory_otp_begin_read()
   EMEMORYOTP_REG(EMEMORYOTP_PDIN) = 0;
   EMEMORYOTP_REG(EMEMORYOTP_PWE) = 0;
   EMEMORYOTP_REG(EMEMORYOTP_PTM) = 0;
-  clkutils_delay_ns(EMEMORYOTP_MIN_TMS * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TMS * 1000);
 
   // Enable chip select
 
   EMEMORYOTP_REG(EMEMORYOTP_PCE) = 1;
-  clkutils_delay_ns(EMEMORYOTP_MIN_TCS * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TCS * 1000);
 }
 
 void ememory_otp_exit_read()
@@ -58,27 +65,38 @@ void ememory_otp_exit_read()
   // Disable chip select
   EMEMORYOTP_REG(EMEMORYOTP_PCE) = 0;
   // Wait before changing PTM
-  clkutils_delay_ns(EMEMORYOTP_MIN_TMH * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TMH * 1000);
 }
 
-unsigned int ememory_otp_read(int address)
+// A read split in two for callers with something better to do than wait
+// out TAS: ememory_otp_read_address(), then ememory_otp_read_data() no
+// sooner than EMEMORYOTP_MIN_TAS us later.
+void ememory_otp_read_address(int address)
 {
+  EMEMORYOTP_REG(EMEMORYOTP_PA) = address;
+}
 
+unsigned int ememory_otp_read_data()
+{
   unsigned int read_value;
-  EMEMORYOTP_REG(EMEMORYOTP_PA) = address;
   // Toggle clock
-  clkutils_delay_ns(EMEMORYOTP_MIN_TAS * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PCLK) = 1;
   // Insert delay until data is ready.
   // There are lots of delays
   // on the chart, but I think this is the most relevant.
   int delay = max(EMEMORYOTP_MAX_TCD, EMEMORYOTP_MIN_TKH);
-  clkutils_delay_ns(delay * 1000);
+  clkutils_ndelay(delay * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PCLK) = 0;
   read_value = EMEMORYOTP_REG(EMEMORYOTP_PDOUT);
   // Could check here for things like TCYC < TAH + TCD
   return read_value;
+}
 
+unsigned int ememory_otp_read(int address)
+{
+  ememory_otp_read_address(address);
+  clkutils_ndelay(EMEMORYOTP_MIN_TAS * 1000);
+  return ememory_otp_read_data();
 }
 
 void ememory_otp_pgm_entry()
@@ -90,22 +108,22 @@ void ememory_otp_pgm_entry()
   EMEMORYOTP_REG(EMEMORYOTP_PDIN) = 0;
   EMEMORYOTP_REG(EMEMORYOTP_PWE) = 0;
   EMEMORYOTP_REG(EMEMORYOTP_PTM) = 2;
-  clkutils_delay_ns(EMEMORYOTP_MIN_TMS * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TMS * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PCE) = 1;
-  clkutils_delay_ns(EMEMORYOTP_TYP_TCSP * 1000);
+  clkutils_ndelay(EMEMORYOTP_TYP_TCSP * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PPROG) = 1;
-  clkutils_delay_ns(EMEMORYOTP_TYP_TPPS * 1000);
+  clkutils_ndelay(EMEMORYOTP_TYP_TPPS * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PTRIM) = 1;
 }
 
 void ememory_otp_pgm_exit()
 {
   EMEMORYOTP_REG(EMEMORYOTP_PWE) = 0;
-  clkutils_delay_ns(EMEMORYOTP_TYP_TPPH * 1000);
+  clkutils_ndelay(EMEMORYOTP_TYP_TPPH * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PPROG) = 0;
-  clkutils_delay_ns(EMEMORYOTP_TYP_TPPR * 1000);
+  clkutils_ndelay(EMEMORYOTP_TYP_TPPR * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PCE) = 0;
-  clkutils_delay_ns(EMEMORYOTP_MIN_TMH * 1000);
+  clkutils_ndelay(EMEMORYOTP_MIN_TMH * 1000);
   EMEMORYOTP_REG(EMEMORYOTP_PTM) = 0;
 
 }
@@ -121,14 +139,42 @@ void ememory_otp_pgm_access(int address, unsigned int write_data)
       EMEMORYOTP_REG(EMEMORYOTP_PAIO) = i;
       EMEMORYOTP_REG(EMEMORYOTP_PDIN) = ((write_data >> i) & 1);
       int delay = max(EMEMORYOTP_MIN_TASP, EMEMORYOTP_MIN_TDSP);
-      clkutils_delay_ns(delay * 1000);
+      clkutils_ndelay(delay * 1000);
       EMEMORYOTP_REG(EMEMORYOTP_PWE) = 1;
-      clkutils_delay_ns(EMEMORYOTP_TYP_TPW * 1000);
+      clkutils_ndelay(EMEMORYOTP_TYP_TPW * 1000);
       EMEMORYOTP_REG(EMEMORYOTP_PWE) = 0;
       delay = max(EMEMORYOTP_MIN_TAHP, EMEMORYOTP_MIN_TDHP);
       delay = max(delay, EMEMORYOTP_TYP_TPWI);
-      clkutils_delay_ns(delay * 1000);
+      clkutils_ndelay(delay * 1000);
     }
   }
   EMEMORYOTP_REG(EMEMORYOTP_PAS) = 0;
 }
+
+void ememory_otp_shadow_init(ememory_otp_shadow* shadow, int base)
+{
+  shadow->magic = EMEMORYOTP_SHADOW_MAGIC;
+  shadow->base = base;
+  for (int i = 0; i < EMEMORYOTP_SHADOW_WORDS / 32; i++) {
+    shadow->valid[i] = 0;
+  }
+}
+
+// Returns 1 and sets *value if address has been read, 0 otherwise
+int ememory_otp_shadow_get(const ememory_otp_shadow* shadow, int address, unsigned int* value)
+{
+  unsigned int i = address - shadow->base;
+  if (i >= EMEMORYOTP_SHADOW_WORDS || !(shadow->valid[i / 32] & (1U << (i % 32)))) {
+    return 0;
+  }
+  *value = shadow->words[i];
+  return 1;
+}
+
+void ememory_otp_shadow_put(ememory_otp_shadow* shadow, int address, unsigned int value)
+{
+  unsigned int i = address - shadow->base;
+  if (i >= EMEMORYOTP_SHADOW_WORDS) return;
+  shadow->words[i] = value;
+  shadow->valid[i / 32] |= 1U << (i % 32);
+}
@@ -6,13 +6,37 @@
 #ifndef EMEMORY_OTP_H
 #define EMEMORY_OTP_H
 
+#include <stdint.h>
+
+extern void ememory_otp_power_up_begin();
 extern void ememory_otp_power_up_sequence();
 extern void ememory_otp_power_down_sequence();
 extern void ememory_otp_begin_read();
 extern void ememory_otp_exit_read();
 unsigned int ememory_otp_read(int address);
+void ememory_otp_read_address(int address);
+unsigned int ememory_otp_read_data();
 void ememory_otp_pgm_entry();
 void ememory_otp_pgm_exit();
 void ememory_otp_pgm_access(int address, unsigned int write_data);
 
+// "OTPS"
+#define EMEMORYOTP_SHADOW_MAGIC 0x5350544f
+#define EMEMORYOTP_SHADOW_WORDS 128
+
+// Copy of a window of OTP words, read once per boot. valid marks the words
+// that were read; words outside [base, base + EMEMORYOTP_SHADOW_WORDS) are
+// not kept. The fsbl fills the whole window before handing it on.
+typedef struct
+{
+  uint32_t magic;
+  uint32_t base;  // OTP address of words[0]
+  uint32_t valid[EMEMORYOTP_SHADOW_WORDS / 32];
+  uint32_t words[EMEMORYOTP_SHADOW_WORDS];
+} ememory_otp_shadow;
+
+void ememory_otp_shadow_init(ememory_otp_shadow* shadow, int base);
+int ememory_otp_shadow_get(const ememory_otp_shadow* shadow, int address, unsigned int* value);
+void ememory_otp_shadow_put(ememory_otp_shadow* shadow, int address, unsigned int value);
+
 #endif
@@ -241,3 +241,54 @@ void fdt_set_prop(uintptr_t fdt, const char *prop, uint8_t* value)
 
   fdt_scan(fdt, &cb);
 }
+
+//////////////////////////////////////////// ENABLED DEVICE FIND ///////////////////////////////////
+
+struct compat_scan {
+  const char *compatible;
+  int match;
+  int disabled;
+  int found;
+};
+
+static void compat_open(const struct fdt_scan_node *node, void *extra)
+{
+  struct compat_scan *scan = (struct compat_scan *)extra;
+  scan->match = 0;
+  scan->disabled = 0;
+}
+
+static void compat_prop(const struct fdt_scan_prop *prop, void *extra)
+{
+  struct compat_scan *scan = (struct compat_scan *)extra;
+  if (!strcmp(prop->name, "compatible") && fdt_string_list_index(prop, scan->compatible) >= 0) {
+    scan->match = 1;
+  } else if (!strcmp(prop->name, "status")) {
+    const char *status = (const char *)prop->value;
+    scan->disabled = strcmp(status, "okay") && strcmp(status, "ok");
+  }
+}
+
+static void compat_done(const struct fdt_scan_node *node, void *extra)
+{
+  struct compat_scan *scan = (struct compat_scan *)extra;
+  if (scan->match && !scan->disabled) scan->found = 1;
+}
+
+// A node without a status property counts as enabled
+int fdt_compatible_enabled(uintptr_t fdt, const char *compatible)
+{
+  struct fdt_cb cb;
+  struct compat_scan scan;
+
+  memset(&cb, 0, sizeof(cb));
+  cb.open = compat_open;
+  cb.prop = compat_prop;
+  cb.done = compat_done;
+  cb.extra = &scan;
+  scan.compatible = compatible;
+  scan.found = 0;
+
+  fdt_scan(fdt, &cb);
+  return scan.found;
+}
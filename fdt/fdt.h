@@ -61,5 +61,6 @@ int fdt_string_list_index(const struct fdt_scan_prop *prop, const char *str); //
 
 void fdt_reduce_mem(uintptr_t fdt, uintptr_t size);
 void fdt_set_prop(uintptr_t fdt, const char *prop, uint8_t *value);
+int fdt_compatible_enabled(uintptr_t fdt, const char *compatible); // any such node not disabled
 
 #endif
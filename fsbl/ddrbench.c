@@ -0,0 +1,257 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <encoding.h>
+#include <sifive/platform.h>
+#include <uart/uart.h>
+#include <clkutils/clkutils.h>
+#include <hartjob/hartjob.h>
+#include "ddrbench.h"
+
+// Size of each of a hart's three STREAM arrays in DDR, well past the ccache
+#ifndef DDRBENCH_DDR_ARRAY_BYTES
+  #define DDRBENCH_DDR_ARRAY_BYTES (8UL * 1024UL * 1024UL)
+#endif
+// Passes over the arrays per STREAM kernel
+#ifndef DDRBENCH_REPS
+  #define DDRBENCH_REPS 8
+#endif
+// Dependent loads per pointer chase
+#ifndef DDRBENCH_CHASE_LOADS
+  #define DDRBENCH_CHASE_LOADS (1UL << 20)
+#endif
+
+#define LINE_BYTES 64
+// The kernels run on 64-bit integers: the boot hart (the E51 on FU540) has no
+// FPU and start.S leaves mstatus.FS off there, so double would trap
+#define SCALAR 3
+// Room left for the per-hart 4 KiB stacks below _sp
+#define SIDEBAND_STACK_BYTES ((DDRBENCH_MAX_HARTS + 1) * 4096)
+
+#define UART ((void*) UART0_CTRL_ADDR)
+
+volatile ddrbench_table ddrbench_results;
+
+typedef struct
+{
+  int region;
+  int test;
+  uintptr_t base;
+  size_t slice;  // bytes of memory per hart
+  size_t words;  // elements per STREAM array
+} bench_job;
+
+static bench_job job;
+
+
+static uint64_t run_stream(const bench_job* j, uint64_t* a)
+{
+  uint64_t* b = a + j->words;
+  uint64_t* c = b + j->words;
+  size_t n = j->words;
+
+  for (int rep = 0; rep < DDRBENCH_REPS; rep++) {
+    switch (j->test) {
+      case DDRBENCH_COPY:
+        for (size_t i = 0; i < n; i++) c[i] = a[i];
+        break;
+      case DDRBENCH_SCALE:
+        for (size_t i = 0; i < n; i++) b[i] = SCALAR * c[i];
+        break;
+      case DDRBENCH_ADD:
+        for (size_t i = 0; i < n; i++) c[i] = a[i] + b[i];
+        break;
+      case DDRBENCH_TRIAD:
+        for (size_t i = 0; i < n; i++) a[i] = b[i] + SCALAR * c[i];
+        break;
+    }
+  }
+
+  int arrays = (j->test == DDRBENCH_ADD || j->test == DDRBENCH_TRIAD) ? 3 : 2;
+  return (uint64_t) arrays * n * sizeof(uint64_t) * DDRBENCH_REPS;
+}
+
+
+/**
+ * Link every line of the slice into one random cycle (Sattolo's algorithm)
+ * so the chase defeats both the prefetcher and the ccache.
+ */
+static void build_chase(uintptr_t base, size_t lines, uint64_t seed)
+{
+  for (size_t i = 0; i < lines; i++) {
+    *(uintptr_t*) (base + i * LINE_BYTES) = i;
+  }
+  for (size_t i = lines - 1; i > 0; i--) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    size_t k = seed % i;
+    uintptr_t* pi = (uintptr_t*) (base + i * LINE_BYTES);
+    uintptr_t* pk = (uintptr_t*) (base + k * LINE_BYTES);
+    uintptr_t t = *pi;
+    *pi = *pk;
+    *pk = t;
+  }
+  // Turn indices into addresses
+  for (size_t i = 0; i < lines; i++) {
+    uintptr_t* p = (uintptr_t*) (base + i * LINE_BYTES);
+    *p = base + *p * LINE_BYTES;
+  }
+}
+
+
+static uintptr_t run_chase(uintptr_t p)
+{
+  for (unsigned long i = 0; i < DDRBENCH_CHASE_LOADS; i++) {
+    p = *(volatile uintptr_t*) p;
+  }
+  return p;
+}
+
+
+static void run_part(const bench_job* j, int part)
+{
+  uintptr_t base = j->base + part * j->slice;
+  int hart = read_csr(mhartid);
+  uint64_t bytes;
+
+  if (j->test == DDRBENCH_CHASE) {
+    build_chase(base, j->slice / LINE_BYTES, 0x9e3779b97f4a7c15UL + hart);
+  }
+
+  uint64_t start = clkutils_read_mtime();
+  if (j->test == DDRBENCH_CHASE) {
+    run_chase(base);
+    bytes = DDRBENCH_CHASE_LOADS;
+  } else {
+    bytes = run_stream(j, (uint64_t*) base);
+  }
+  uint64_t ticks = clkutils_read_mtime() - start;
+
+  if (hart < DDRBENCH_MAX_HARTS) {
+    ddrbench_results.hart[j->region][j->test][hart].bytes = bytes;
+    ddrbench_results.hart[j->region][j->test][hart].ticks = ticks;
+  }
+}
+
+
+static void bench_worker(void* arg, int worker, int num_workers)
+{
+  run_part((const bench_job*) arg, worker);
+}
+
+
+static void put_dec(uint64_t n)
+{
+  char buf[21];
+  int i = sizeof(buf) - 1;
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + (n % 10);
+    n /= 10;
+  } while (n);
+  uart_puts(UART, &buf[i]);
+}
+
+
+// bytes per microsecond is MB/s, loads are reported as ns per load
+static void put_sample(int test, volatile ddrbench_sample* s)
+{
+  uint64_t ns = s->ticks * RTC_PERIOD_NS;
+  if (test == DDRBENCH_CHASE) {
+    put_dec(s->bytes ? ns / s->bytes : 0);
+    uart_puts(UART, " ns");
+  } else {
+    put_dec(ns ? s->bytes * 1000 / ns : 0);
+    uart_puts(UART, " MB/s");
+  }
+}
+
+
+static void run_region(int region, uintptr_t base, size_t size, int parts)
+{
+  static const char* const names[DDRBENCH_NUM_TESTS] = {
+    "copy", "scale", "add", "triad", "chase",
+  };
+  bench_job* j = &job;
+
+  j->region = region;
+  j->base = base;
+  j->slice = (size / parts) & ~(size_t) (LINE_BYTES - 1);
+  j->words = j->slice / 3 / sizeof(uint64_t);
+  if (j->slice < 2 * LINE_BYTES) return;
+
+  uart_puts(UART, region == DDRBENCH_REGION_DDR ? "\r\nDDR:" : "\r\nSideband:");
+  for (int test = 0; test < DDRBENCH_NUM_TESTS; test++) {
+    j->test = test;
+
+    uint64_t start = clkutils_read_mtime();
+    int n = hartjob_start(bench_worker, j);
+    run_part(j, n);
+    if (n) hartjob_wait();
+    uint64_t wall = clkutils_read_mtime() - start;
+
+    uint64_t bytes = 0;
+    uint64_t ticks = 0;
+    uart_puts(UART, "\r\n  ");
+    uart_puts(UART, names[test]);
+    uart_puts(UART, ":");
+    for (int hart = 0; hart < DDRBENCH_MAX_HARTS; hart++) {
+      volatile ddrbench_sample* s = &ddrbench_results.hart[region][test][hart];
+      if (!s->ticks && !s->bytes) continue;
+      bytes += s->bytes;
+      ticks += s->ticks;
+      uart_puts(UART, " ");
+      put_dec(hart);
+      uart_puts(UART, "=");
+      put_sample(test, s);
+    }
+
+    volatile ddrbench_sample* t = &ddrbench_results.total[region][test];
+    t->bytes = bytes;
+    t->ticks = test == DDRBENCH_CHASE ? ticks : wall;
+    uart_puts(UART, " all=");
+    put_sample(test, t);
+  }
+}
+
+
+/**
+ * Measure STREAM bandwidth and pointer-chase latency on every hart.
+ *
+ * Runs once over DDR at ddr_base and once over the free part of the ccache
+ * sideband this program runs from. Results are printed on UART0 and left in
+ * ddrbench_results.
+ */
+void ddrbench_run(uintptr_t ddr_base, uint64_t ddr_size)
+{
+  extern char _end[], _sp[];
+  int parts = hartjob_num_workers() + 1;
+
+  ddrbench_results.magic = DDRBENCH_MAGIC;
+  ddrbench_results.version = DDRBENCH_VERSION;
+  ddrbench_results.num_harts = parts;
+  ddrbench_results.rtc_hz = RTC_FREQUENCY_HZ;
+  ddrbench_results.corepllcfg = UX00PRCI_REG(UX00PRCI_COREPLLCFG);
+  ddrbench_results.ddrpllcfg = UX00PRCI_REG(UX00PRCI_DDRPLLCFG);
+  ddrbench_results.complete = 0;
+
+  uint64_t ddr_bytes = (uint64_t) parts * 3 * DDRBENCH_DDR_ARRAY_BYTES;
+  if (ddr_bytes > ddr_size) ddr_bytes = ddr_size;
+  run_region(DDRBENCH_REGION_DDR, ddr_base, ddr_bytes, parts);
+
+  uintptr_t sb_base = ((uintptr_t) _end + LINE_BYTES - 1) & ~(uintptr_t) (LINE_BYTES - 1);
+  uintptr_t sb_end = (uintptr_t) _sp - SIDEBAND_STACK_BYTES;
+  if (sb_end > sb_base) {
+    run_region(DDRBENCH_REGION_SIDEBAND, sb_base, sb_end - sb_base, parts);
+  }
+
+  uart_puts(UART, "\r\nResults at ");
+  uart_put_hex64(UART, (uintptr_t) &ddrbench_results);
+  uart_puts(UART, "\r\n");
+  ddrbench_results.complete = 1;
+}
@@ -0,0 +1,65 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _FSBL_DDRBENCH_H
+#define _FSBL_DDRBENCH_H
+
+// "DDRBENCH"
+#define DDRBENCH_MAGIC 0x48434e4542524444UL
+#define DDRBENCH_VERSION 1
+
+#define DDRBENCH_MAX_HARTS 5
+
+// Tests, STREAM kernels first
+#define DDRBENCH_COPY 0
+#define DDRBENCH_SCALE 1
+#define DDRBENCH_ADD 2
+#define DDRBENCH_TRIAD 3
+#define DDRBENCH_CHASE 4
+#define DDRBENCH_NUM_TESTS 5
+
+// Memory under test
+#define DDRBENCH_REGION_DDR 0
+#define DDRBENCH_REGION_SIDEBAND 1
+#define DDRBENCH_NUM_REGIONS 2
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+typedef struct
+{
+  uint64_t bytes;  // bytes moved, or loads issued by the pointer chase
+  uint64_t ticks;  // mtime ticks taken
+} ddrbench_sample;
+
+/**
+ * Result table left in memory for the debugger to read.
+ *
+ * hart[][][] is indexed by mhartid. For the STREAM kernels total[][] holds
+ * the bytes moved by all harts and the wall time of the whole run; for the
+ * pointer chase it holds the sum over harts, i.e. the mean latency.
+ * complete is written last.
+ */
+typedef struct
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t num_harts;
+  uint32_t rtc_hz;
+  uint32_t corepllcfg;
+  uint32_t ddrpllcfg;
+  uint32_t complete;
+  ddrbench_sample hart[DDRBENCH_NUM_REGIONS][DDRBENCH_NUM_TESTS][DDRBENCH_MAX_HARTS];
+  ddrbench_sample total[DDRBENCH_NUM_REGIONS][DDRBENCH_NUM_TESTS];
+} ddrbench_table;
+
+extern volatile ddrbench_table ddrbench_results;
+
+void ddrbench_run(uintptr_t ddr_base, uint64_t ddr_size);
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _FSBL_DDRBENCH_H */
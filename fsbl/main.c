@@ -27,19 +27,29 @@
 
 #include <sifive/platform.h>
 #include <sifive/barrier.h>
+#include <sifive/smp.h>
 #include <stdatomic.h>
 
 #include <sifive/devices/ccache.h>
 #include <sifive/devices/gpio.h>
 #include <spi/spi.h>
 #include <ux00boot/ux00boot.h>
+#include <hartjob/hartjob.h>
+#include <dma/dma.h>
 #include <gpt/gpt.h>
+#include <clkutils/clkutils.h>
+#include <sched/sched.h>
+#ifdef BOARD_SETUP
+#include "fsbl/ddrbench.h"
+#endif
 
 #define NUM_CORES 5
 
 #ifndef PAYLOAD_DEST
   #define PAYLOAD_DEST MEMORY_MEM_ADDR
 #endif
+// The payload may use DDR up to the DTB copy, 2MB below the top
+#define PAYLOAD_MAX_SIZE (DDR_SIZE - 0x200000)
 
 #ifndef SPI_MEM_ADDR
   #ifndef SPI_NUM
@@ -113,21 +123,484 @@ void update_peripheral_clock_dividers(unsigned int peripheral_input_khz)
   }
 }
 
-long nsec_per_cyc = 300; // 33.333MHz
-void nsleep(long nsec) {
-  long step = nsec_per_cyc*2; // 2 instructions per loop iteration
-  while (nsec > 0) nsec -= step;
-}
-
 int puts(const char * str){
 	uart_puts((void *) UART0_CTRL_ADDR, str);
 	return 1;
 }
 
+#ifdef DDR_ECC_SCRUB
+// Scrub progress is reported after every chunk
+#ifndef DDR_ECC_SCRUB_CHUNK
+  #define DDR_ECC_SCRUB_CHUNK (256UL * 1024UL * 1024UL)
+#endif
+
+static void put_dec(uint64_t n)
+{
+  char buf[21];
+  int i = sizeof(buf) - 1;
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + (n % 10);
+    n /= 10;
+  } while (n);
+  puts(&buf[i]);
+}
+
+static uint64_t scrub_done;
+static uint64_t scrub_start_ns;
+// Set while a DDR_ECC_SCRUB_DMA chunk is on the engine
+static int scrub_busy;
+
+/**
+ * Write every line of DDR once so that ECC is valid before anything reads it.
+ *
+ * Scrubs one chunk per call, returning SCHED_AGAIN until the last, so the
+ * scheduler can step the tasks that don't need DDR in between.
+ *
+ * By default each chunk is split into cache-line-aligned slices across the
+ * boot hart and the secondary harts. With DDR_ECC_SCRUB_DMA the DMA engine
+ * streams the zero source over it instead, at most CACHEABLE_ZERO_MEM_SIZE
+ * at a time, and the other tasks run until it is done.
+ */
+static int ddr_ecc_scrub(uintptr_t base, uint64_t size)
+{
+  void* p = (void*) (base + scrub_done);
+  if (scrub_done == 0 && !scrub_busy) {
+    puts("\r\nScrubbing DDR: ");
+    scrub_start_ns = clkutils_read_ns();
+  }
+  uint64_t len = size - scrub_done;
+  if (len > DDR_ECC_SCRUB_CHUNK) len = DDR_ECC_SCRUB_CHUNK;
+#ifdef DDR_ECC_SCRUB_DMA
+  if (len > CACHEABLE_ZERO_MEM_SIZE) len = CACHEABLE_ZERO_MEM_SIZE;
+  if (!scrub_busy) {
+    if (dma_submit_zero(DMA_CHANNEL_BOOT, p, len) == 0) {
+      scrub_busy = 1;
+      return SCHED_AGAIN;
+    }
+    memset(p, 0, len);
+  } else {
+    int rc = dma_poll(DMA_CHANNEL_BOOT);
+    if (rc == DMA_BUSY) return SCHED_AGAIN;
+    scrub_busy = 0;
+    if (rc) memset(p, 0, len);
+  }
+#else
+  hartjob_memset(p, 0, len);
+#endif
+  scrub_done += len;
+  puts("\rScrubbing DDR: ");
+  put_dec(scrub_done * 100 / size);
+  puts("%");
+  if (scrub_done < size) return SCHED_AGAIN;
+
+  // Bytes per microsecond is MB/s
+  uint64_t us = (clkutils_read_ns() - scrub_start_ns) / 1000;
+  puts(" in ");
+  put_dec(us / 1000);
+  puts(" ms, ");
+  put_dec(us ? size / us : 0);
+  puts(" MB/s");
+#ifndef DDR_ECC_SCRUB_DMA
+  puts(" on ");
+  put_dec(hartjob_num_workers() + 1);
+  puts(" harts");
+#endif
+  return SCHED_DONE;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Boot tasks
+//
+// DDR training runs in the background from ux00ddr_begin_start(), and every
+// hardware wait below is a deadline the scheduler sleeps out while the other
+// tasks run. Only the DTB copy and the payload load wait for DDR; the tasks
+// before them keep their buffers in the sideband. The DTB is copied on the
+// DMA engine while the payload loads and edited once both are done.
+
+enum {
+  TASK_DDR,
+  TASK_BANNER,
+  TASK_GEMGXL,  // ahead of the SD work so the PLL locks behind it
+  TASK_FIND_PAYLOAD,
+  TASK_SERIAL,
+  TASK_DTB_COPY,
+  TASK_LOAD_PAYLOAD,
+  TASK_DTB,
+  NUM_TASKS
+};
+
+static unsigned long boot_dtb;
+
+#ifndef BOARD_SETUP
+static ux00boot_gpt_lookup payload_lookup;
+static char build_date[11] = "YYYY-MM-DD";
+#ifndef SKIP_OTP_MAC
+// SiFive MA-S MAC block; default to serial 0
+static unsigned char mac[6] = { 0x70, 0xb3, 0xd5, 0x92, 0xf0, 0x00 };
+#endif
+#endif
+
+
+static int finish_ddr_start(sched_task* task)
+{
+  switch (task->state) {
+    case 0:
+      if (!ux00ddr_init_complete(UX00DDR_CTRL_ADDR)) {
+        return SCHED_AGAIN;
+      }
+      ux00ddr_open_filter(PHYSICAL_FILTER_CTRL_ADDR, PAYLOAD_DEST + DDR_SIZE);
+
+      ux00ddr_phy_fixup(UX00DDR_CTRL_ADDR);
+#ifdef DDR_ECC_SCRUB
+      task->state = 1;
+      return SCHED_AGAIN;
+    case 1:
+      // Tasks after TASK_DDR wait for the whole scrub
+      return ddr_ecc_scrub(PAYLOAD_DEST, DDR_SIZE);
+#endif
+  }
+  return SCHED_DONE;
+}
+
+
+#if defined(BOARD_SETUP) || !defined(SKIP_GEMGXL)
+//#ifdef VSC8541_PHY
+#define PHY_NRESET 0x1000
+
+// The GEMGXL PLL and VSC8541 PHY are left in reset unless the DTB handed to
+// the payload has the MAC enabled. BOARD_SETUP always brings them up, and
+// SKIP_GEMGXL never does. With SKIP_DTB_DDR_RANGE, or no valid DTB at all,
+// there is nothing to go by and they are brought up as before.
+static int setup_gemgxl(sched_task* task)
+{
+  switch (task->state) {
+    case 0: {
+#if !defined(BOARD_SETUP) && !defined(SKIP_DTB_DDR_RANGE)
+      if (fdt_size(boot_dtb) && !fdt_compatible_enabled(boot_dtb, "cdns,macb")) {
+        return SCHED_DONE;
+      }
+#endif
+      uint32_t gemgxl125mhz =
+        (PLL_R(0)) |
+        (PLL_F(59)) |  /*4000Mhz VCO*/
+        (PLL_Q(5)) |   /* /32 */
+        (PLL_RANGE(0x4)) |
+        (PLL_BYPASS(0)) |
+        (PLL_FSE(1));
+      UX00PRCI_REG(UX00PRCI_GEMGXLPLLCFG) = gemgxl125mhz;
+      task->state = 1;
+      return SCHED_AGAIN;
+    }
+    case 1: {
+      // Wait for lock
+      if ((UX00PRCI_REG(UX00PRCI_GEMGXLPLLCFG) & PLL_LOCK(1)) == 0) {
+        return SCHED_AGAIN;
+      }
+      uint32_t gemgxlctl_out =
+        (PLLOUT_DIV(PLLOUT_DIV_default)) |
+        (PLLOUT_DIV_BY_1(PLLOUT_DIV_BY_1_default)) |
+        (PLLOUT_CLK_EN(1));
+      UX00PRCI_REG(UX00PRCI_GEMGXLPLLOUT) = gemgxlctl_out;
+
+      //Release GEMGXL reset (set bit DEVICESRESET_GEMGXL to 1)
+      UX00PRCI_REG(UX00PRCI_DEVICESRESETREG) |= DEVICESRESET_GEMGXL_RST_N(1);
+
+      // VSC8541 PHY reset sequence; leave pull-down active for 2ms
+      task->state = 2;
+      return sched_sleep_us(task, 2000);
+    }
+    case 2:
+      // Set GPIO 12 (PHY NRESET) to OE=1 and OVAL=1
+      atomic_fetch_or(&GPIO_REG(GPIO_OUTPUT_VAL), PHY_NRESET);
+      atomic_fetch_or(&GPIO_REG(GPIO_OUTPUT_EN),  PHY_NRESET);
+      task->state = 3;
+      return sched_sleep_ns(task, 100);
+    case 3:
+      // Reset PHY again to enter unmanaged mode
+      atomic_fetch_and(&GPIO_REG(GPIO_OUTPUT_VAL), ~PHY_NRESET);
+      task->state = 4;
+      return sched_sleep_ns(task, 100);
+    case 4:
+      atomic_fetch_or(&GPIO_REG(GPIO_OUTPUT_VAL), PHY_NRESET);
+      task->state = 5;
+      return sched_sleep_us(task, 15000);
+  }
+  return SCHED_DONE;
+}
+//#endif
+#endif
+
+
+#ifndef BOARD_SETUP
+#ifndef SKIP_DTB_DDR_RANGE
+static int print_banner(sched_task* task)
+{
+#define DEQ(mon, x) ((cdate[0] == mon[0] && cdate[1] == mon[1] && cdate[2] == mon[2]) ? x : 0)
+
+  const char *cdate = __DATE__;
+  int month =
+    DEQ("Jan", 1) | DEQ("Feb",  2) | DEQ("Mar",  3) | DEQ("Apr",  4) |
+    DEQ("May", 5) | DEQ("Jun",  6) | DEQ("Jul",  7) | DEQ("Aug",  8) |
+    DEQ("Sep", 9) | DEQ("Oct", 10) | DEQ("Nov", 11) | DEQ("Dec", 12);
+
+  char *date = build_date;
+  date[0] = cdate[7];
+  date[1] = cdate[8];
+  date[2] = cdate[9];
+  date[3] = cdate[10];
+  date[5] = '0' + (month/10);
+  date[6] = '0' + (month%10);
+  date[8] = cdate[4];
+  date[9] = cdate[5];
+
+  // Post the serial number and build info
+  extern const char * gitid;
+  UART0_REG(UART_REG_CTRL) = UART_RST_TX;
+  
+  puts("\r\nSiFive FSBL:       ");
+  puts(date);
+  puts("-");
+  puts(gitid);
+  // If chiplink is connected and has a DTB, use that DTB instead of what we have
+  // compiled-in. This will be replaced with a real bootloader with overlays in
+  // the future
+  uint32_t *chiplink_dtb = (uint32_t*)0x2ff0000000UL;
+  if (*chiplink_dtb == 0xedfe0dd0){
+	boot_dtb = (uintptr_t)chiplink_dtb;
+	puts("\r\nUsing Chiplink DTB");
+  } else if (own_dtb == 0xedfe0dd0){
+	boot_dtb = (uintptr_t)&own_dtb;
+	puts("\r\nUsing FSBL DTB");
+  }
+  return SCHED_DONE;
+}
+
+
+#ifndef SKIP_OTP_MAC
+#define FIRST_SLOT	0xfe
+#define LAST_SLOT	0x80
+#define NUM_SLOTS	((FIRST_SLOT - LAST_SLOT) / 2 + 1)
+#define SLOT_ADDR(i)	(FIRST_SLOT - 2 * (i))
+
+// Where the OTP shadow is left for the payload, named by the DTB's
+// sifive,otp-shadow property. ux00_fsbl.dts reserves this page as no-map, so
+// keep the two in step.
+#define OTP_SHADOW_ADDR (PAYLOAD_DEST + DDR_SIZE - 0x1000)
+
+_Static_assert(FIRST_SLOT + 2 - LAST_SLOT <= EMEMORYOTP_SHADOW_WORDS,
+               "the OTP shadow must hold every slot");
+
+static ememory_otp_shadow otp_shadow;
+static int otp_next;
+
+static unsigned int serial = ~0;
+static int serial_slot;
+
+static unsigned int slot_word(int address)
+{
+  unsigned int value = ~0;
+  ememory_otp_shadow_get(&otp_shadow, address, &value);
+  return value;
+}
+
+static int slot_empty(int address)
+{
+  return slot_word(address) == ~0 && slot_word(address+1) == ~0;
+}
+
+/*
+ * The whole slot window [LAST_SLOT, FIRST_SLOT + 1] is read into otp_shadow
+ * in one pass, a word per step with a single TAS wait that the other tasks
+ * run through, and handed on to the payload complete.
+ *
+ * Slots are used from FIRST_SLOT down: erased slots, then at most one legal
+ * serial, then empty slots. A binary search of the shadow for the first empty
+ * slot finds the serial in the slot above it.
+ */
+static int read_serial(sched_task* task)
+{
+  switch (task->state) {
+    case 0:
+      ememory_otp_power_up_begin();
+      task->state = 1;
+      return sched_sleep_us(task, EMEMORYOTP_MIN_TTAS);
+    case 1:
+      ememory_otp_begin_read();
+      ememory_otp_shadow_init(&otp_shadow, LAST_SLOT);
+      otp_next = LAST_SLOT;
+      ememory_otp_read_address(otp_next);
+      task->state = 2;
+      return sched_sleep_us(task, EMEMORYOTP_MIN_TAS);
+    case 2:
+      ememory_otp_shadow_put(&otp_shadow, otp_next, ememory_otp_read_data());
+      if (++otp_next <= FIRST_SLOT + 1) {
+        ememory_otp_read_address(otp_next);
+        return sched_sleep_us(task, EMEMORYOTP_MIN_TAS);
+      }
+      break;
+  }
+
+  int slot_lo = 0;
+  int slot_hi = NUM_SLOTS;
+  while (slot_lo < slot_hi) {
+    int mid = (slot_lo + slot_hi) / 2;
+    if (slot_empty(SLOT_ADDR(mid))) {
+      slot_hi = mid;
+    } else {
+      slot_lo = mid + 1;
+    }
+  }
+  // slot_lo is now the first empty slot, or NUM_SLOTS if there is none
+  if (slot_lo > 0 && slot_word(SLOT_ADDR(slot_lo - 1)) == ~slot_word(SLOT_ADDR(slot_lo - 1) + 1)) {
+    serial_slot = SLOT_ADDR(slot_lo - 1); // legal serial #
+    serial = slot_word(serial_slot);
+  } else if (slot_lo < NUM_SLOTS) {
+    serial_slot = SLOT_ADDR(slot_lo); // empty slot encountered
+    serial = ~0;
+  } else {
+    serial_slot = LAST_SLOT - 2;
+    serial = slot_word(LAST_SLOT);
+  }
+  ememory_otp_exit_read();
+
+  void *uart = (void*)UART0_CTRL_ADDR;
+  uart_puts(uart, "\r\nHiFive-U serial #: ");
+  uart_put_hex(uart, serial);
+
+  // Program the OTP?
+  if (serial_to_burn != ~0 && serial != serial_to_burn && serial_slot > LAST_SLOT) {
+    uart_puts(uart, "Programming serial: ");
+    uart_put_hex(uart, serial_to_burn);
+    uart_puts(uart, "\r\n");
+    ememory_otp_pgm_entry();
+    if (serial != ~0) {
+      // erase the current serial
+      uart_puts(uart, "Erasing prior serial\r\n");
+      ememory_otp_pgm_access(serial_slot,   0);
+      ememory_otp_pgm_access(serial_slot+1, 0);
+      ememory_otp_shadow_put(&otp_shadow, serial_slot,   0);
+      ememory_otp_shadow_put(&otp_shadow, serial_slot+1, 0);
+      serial_slot -= 2;
+    }
+    ememory_otp_pgm_access(serial_slot,    serial_to_burn);
+    ememory_otp_pgm_access(serial_slot+1, ~serial_to_burn);
+    ememory_otp_pgm_exit();
+    ememory_otp_shadow_put(&otp_shadow, serial_slot,    serial_to_burn);
+    ememory_otp_shadow_put(&otp_shadow, serial_slot+1, ~serial_to_burn);
+    uart_puts(uart, "Resuming boot\r\n");
+    serial = serial_to_burn;
+  }
+
+  ememory_otp_power_down_sequence();
+
+  if (serial != ~0) {
+    mac[5] |= (serial >>  0) & 0xff;
+    mac[4] |= (serial >>  8) & 0xff;
+    mac[3] |= (serial >> 16) & 0xff;
+  }
+  return SCHED_DONE;
+}
+#endif
+
+
+// Set while the DMA engine is copying the DTB to dtb_target
+static int dtb_copy_busy;
+
+static int start_dtb_copy(sched_task* task)
+{
+  size_t size = fdt_size(boot_dtb);
+  dtb_copy_busy = size >= DMA_MIN_BYTES &&
+    !dma_submit(DMA_CHANNEL_BOOT, (void*)dtb_target, (const void*)boot_dtb, size);
+  if (!dtb_copy_busy) {
+    memcpy((void*)dtb_target, (void*)boot_dtb, size);
+  }
+  uart_puts((void*)UART0_CTRL_ADDR, "\r\n");
+  return SCHED_DONE;
+}
+
+
+// Wait for the DTB copy, then reduce the reported memory to match DDR
+static int fixup_dtb(sched_task* task)
+{
+  if (dtb_copy_busy) {
+    int rc = dma_poll(DMA_CHANNEL_BOOT);
+    if (rc == DMA_BUSY) return SCHED_AGAIN;
+    dtb_copy_busy = 0;
+    if (rc) memcpy((void*)dtb_target, (void*)boot_dtb, fdt_size(boot_dtb));
+  }
+  fdt_reduce_mem(dtb_target, DDR_SIZE); // reduce the RAM to physically present only
+  fdt_set_prop(dtb_target, "sifive,fsbl", (uint8_t*)&build_date[0]);
+#ifndef SKIP_OTP_MAC
+  fdt_set_prop(dtb_target, "local-mac-address", &mac[0]);
+
+  memcpy((void*)OTP_SHADOW_ADDR, &otp_shadow, sizeof(otp_shadow));
+  uint32_t shadow_addr[2] = {
+    __builtin_bswap32((uint64_t)OTP_SHADOW_ADDR >> 32),
+    __builtin_bswap32((uint32_t)OTP_SHADOW_ADDR),
+  };
+  fdt_set_prop(dtb_target, "sifive,otp-shadow", (uint8_t*)&shadow_addr[0]);
+#endif
+  return SCHED_DONE;
+}
+#endif
+
+
+static int find_payload(sched_task* task)
+{
+  const gpt_guid* guid = &gpt_guid_sifive_bare_metal;
+  ux00boot_find_gpt_partitions(&payload_lookup, &guid, 1);
+  return SCHED_DONE;
+}
+
+
+static int load_payload(sched_task* task)
+{
+  void* dst = (void*) PAYLOAD_DEST;
+  size_t dst_size = PAYLOAD_MAX_SIZE;
+  puts("Loading boot payload");
+  ux00boot_load_found_partitions(&payload_lookup, &dst, &dst_size);
+  return SCHED_DONE;
+}
+#endif
+
+
+static sched_task boot_tasks[NUM_TASKS] = {
+  [TASK_DDR] = { finish_ddr_start },
+#ifdef BOARD_SETUP
+  [TASK_GEMGXL] = { setup_gemgxl },
+#else
+#ifndef SKIP_GEMGXL
+  // Needs the DTB chosen by print_banner()
+  [TASK_GEMGXL] = { setup_gemgxl, SCHED_AFTER(TASK_BANNER) },
+#endif
+#ifndef SKIP_DTB_DDR_RANGE
+  [TASK_BANNER] = { print_banner },
+#ifndef SKIP_OTP_MAC
+  [TASK_SERIAL] = { read_serial, SCHED_AFTER(TASK_BANNER) },
+#endif
+  [TASK_DTB_COPY] = {
+    start_dtb_copy,
+    SCHED_AFTER(TASK_DDR) | SCHED_AFTER(TASK_BANNER) | SCHED_AFTER(TASK_SERIAL)
+  },
+  [TASK_DTB] = { fixup_dtb, SCHED_AFTER(TASK_DTB_COPY) },
+#endif
+  [TASK_FIND_PAYLOAD] = { find_payload },
+  [TASK_LOAD_PAYLOAD] = {
+    load_payload,
+    SCHED_AFTER(TASK_DDR) | SCHED_AFTER(TASK_FIND_PAYLOAD) | SCHED_AFTER(TASK_DTB_COPY)
+  },
+#endif
+};
+
+
 //HART 0 runs main
 
 int main(int id, unsigned long dtb)
 {
+  boot_dtb = dtb;
+
   // PRCI init
 
   // Initialize UART divider for 33MHz core clock in case if trap is taken prior
@@ -169,14 +642,12 @@ int main(int id, unsigned long dtb)
   // Otherwise, set corepll 33MHz -> 500MHz.
   
   if (UX00PRCI_REG(UX00PRCI_CLKMUXSTATUSREG) & CLKMUX_STATUS_TLCLKSEL){
-    nsec_per_cyc = 2;
     peripheral_input_khz = 500000; // peripheral_clk = tlclk
     update_peripheral_clock_dividers(peripheral_input_khz);
     ux00prci_select_corepll_500MHz(&UX00PRCI_REG(UX00PRCI_CORECLKSELREG),
                                    &UX00PRCI_REG(UX00PRCI_COREPLLCFG),
                                    &UX00PRCI_REG(UX00PRCI_COREPLLOUT));
   } else {
-    nsec_per_cyc = 1;
     peripheral_input_khz = (1000000 / 2); // peripheral_clk = tlclk
     update_peripheral_clock_dividers(peripheral_input_khz);
     
@@ -184,6 +655,8 @@ int main(int id, unsigned long dtb)
                                  &UX00PRCI_REG(UX00PRCI_COREPLLCFG),
                                  &UX00PRCI_REG(UX00PRCI_COREPLLOUT));
   }
+  // Delays and the scheduler's deadlines run off mcycle at the new rate
+  clkutils_calibrate();
   
   //
   //DDR init
@@ -236,163 +709,27 @@ int main(int id, unsigned long dtb)
   ux00ddr_setuprangeprotection(UX00DDR_CTRL_ADDR,DDR_SIZE);
   ux00ddr_mask_port_command_error_interrupt(UX00DDR_CTRL_ADDR);
 
-  const uint64_t ddr_size = DDR_SIZE;
-  const uint64_t ddr_end = PAYLOAD_DEST + ddr_size;
-  ux00ddr_start(UX00DDR_CTRL_ADDR, PHYSICAL_FILTER_CTRL_ADDR, ddr_end);
-
-  ux00ddr_phy_fixup(UX00DDR_CTRL_ADDR); 
-  
-  //
-  //GEMGXL init
-  //
-
-  uint32_t gemgxl125mhz =
-    (PLL_R(0)) |
-    (PLL_F(59)) |  /*4000Mhz VCO*/
-    (PLL_Q(5)) |   /* /32 */
-    (PLL_RANGE(0x4)) |
-    (PLL_BYPASS(0)) |
-    (PLL_FSE(1));
-  UX00PRCI_REG(UX00PRCI_GEMGXLPLLCFG) = gemgxl125mhz;
-
-  // Wait for lock
-  while ((UX00PRCI_REG(UX00PRCI_GEMGXLPLLCFG) & PLL_LOCK(1)) == 0) ;
-
-  uint32_t gemgxlctl_out =
-    (PLLOUT_DIV(PLLOUT_DIV_default)) |
-    (PLLOUT_DIV_BY_1(PLLOUT_DIV_BY_1_default)) |
-    (PLLOUT_CLK_EN(1));
-  UX00PRCI_REG(UX00PRCI_GEMGXLPLLOUT) = gemgxlctl_out;
-
-  //Release GEMGXL reset (set bit DEVICESRESET_GEMGXL to 1)
-  UX00PRCI_REG(UX00PRCI_DEVICESRESETREG) |= DEVICESRESET_GEMGXL_RST_N(1);
-
-//#ifdef VSC8541_PHY
-#define PHY_NRESET 0x1000
-
-  // VSC8541 PHY reset sequence; leave pull-down active for 2ms
-  nsleep(2000000);
-  // Set GPIO 12 (PHY NRESET) to OE=1 and OVAL=1
-  atomic_fetch_or(&GPIO_REG(GPIO_OUTPUT_VAL), PHY_NRESET);
-  atomic_fetch_or(&GPIO_REG(GPIO_OUTPUT_EN),  PHY_NRESET);
-  nsleep(100);
-  // Reset PHY again to enter unmanaged mode
-  atomic_fetch_and(&GPIO_REG(GPIO_OUTPUT_VAL), ~PHY_NRESET);
-  nsleep(100);
-  atomic_fetch_or(&GPIO_REG(GPIO_OUTPUT_VAL), PHY_NRESET);
-  nsleep(15000000);
-//#endif
+  ux00ddr_begin_start(UX00DDR_CTRL_ADDR);
+#ifndef BOARD_SETUP
+  dtb_target = PAYLOAD_DEST + PAYLOAD_MAX_SIZE;
+#endif
 
   // Procmon => core clock
   UX00PRCI_REG(UX00PRCI_PROCMONCFG) = 0x1 << 24;
 
+  sched_run(boot_tasks, NUM_TASKS);
+
 #ifdef BOARD_SETUP
+#ifdef DDR_BENCH
+  ddrbench_run(PAYLOAD_DEST, DDR_SIZE);
+  hartjob_release();
+#endif
   asm volatile ("ebreak");
 #else
-  // Copy the DTB and reduce the reported memory to match DDR
-  dtb_target = ddr_end - 0x200000; // - 2MB
-#ifndef SKIP_DTB_DDR_RANGE
-#define DEQ(mon, x) ((cdate[0] == mon[0] && cdate[1] == mon[1] && cdate[2] == mon[2]) ? x : 0)
-
-  const char *cdate = __DATE__;
-  int month =
-    DEQ("Jan", 1) | DEQ("Feb",  2) | DEQ("Mar",  3) | DEQ("Apr",  4) |
-    DEQ("May", 5) | DEQ("Jun",  6) | DEQ("Jul",  7) | DEQ("Aug",  8) |
-    DEQ("Sep", 9) | DEQ("Oct", 10) | DEQ("Nov", 11) | DEQ("Dec", 12);
-
-  char date[11] = "YYYY-MM-DD";
-  date[0] = cdate[7];
-  date[1] = cdate[8];
-  date[2] = cdate[9];
-  date[3] = cdate[10];
-  date[5] = '0' + (month/10);
-  date[6] = '0' + (month%10);
-  date[8] = cdate[4];
-  date[9] = cdate[5];
-
-  // Post the serial number and build info
-  extern const char * gitid;
-  UART0_REG(UART_REG_CTRL) = UART_RST_TX;
-  
-  puts("\r\nSiFive FSBL:       ");
-  puts(date);
-  puts("-");
-  puts(gitid);
-  // If chiplink is connected and has a DTB, use that DTB instead of what we have
-  // compiled-in. This will be replaced with a real bootloader with overlays in
-  // the future
-  uint32_t *chiplink_dtb = (uint32_t*)0x2ff0000000UL;
-  if (*chiplink_dtb == 0xedfe0dd0){
-	dtb = (uintptr_t)chiplink_dtb;
-	puts("\r\nUsing Chiplink DTB");
-  } else if (own_dtb == 0xedfe0dd0){
-	dtb = (uintptr_t)&own_dtb;
-	puts("\r\nUsing FSBL DTB");
-  }
-  memcpy((void*)dtb_target, (void*)dtb, fdt_size(dtb));
-  fdt_reduce_mem(dtb_target, ddr_size); // reduce the RAM to physically present only
-  fdt_set_prop(dtb_target, "sifive,fsbl", (uint8_t*)&date[0]);
-
-#ifndef SKIP_OTP_MAC
-#define FIRST_SLOT	0xfe
-#define LAST_SLOT	0x80
-
-  unsigned int serial = ~0;
-  int serial_slot;
-  ememory_otp_power_up_sequence();
-  ememory_otp_begin_read();
-  for (serial_slot = FIRST_SLOT; serial_slot >= LAST_SLOT; serial_slot -= 2) {
-    unsigned int pos = ememory_otp_read(serial_slot);
-    unsigned int neg = ememory_otp_read(serial_slot+1);
-    serial = pos;
-    if (pos == ~neg) break; // legal serial #
-    if (pos == ~0 && neg == ~0) break; // empty slot encountered
-  }
-  ememory_otp_exit_read();
-
-  void *uart = (void*)UART0_CTRL_ADDR;
-  uart_puts(uart, "\r\nHiFive-U serial #: ");
-  uart_put_hex(uart, serial);
-
-  // Program the OTP?
-  if (serial_to_burn != ~0 && serial != serial_to_burn && serial_slot > LAST_SLOT) {
-    uart_puts(uart, "Programming serial: ");
-    uart_put_hex(uart, serial_to_burn);
-    uart_puts(uart, "\r\n");
-    ememory_otp_pgm_entry();
-    if (serial != ~0) {
-      // erase the current serial
-      uart_puts(uart, "Erasing prior serial\r\n");
-      ememory_otp_pgm_access(serial_slot,   0);
-      ememory_otp_pgm_access(serial_slot+1, 0);
-      serial_slot -= 2;
-    }
-    ememory_otp_pgm_access(serial_slot,    serial_to_burn);
-    ememory_otp_pgm_access(serial_slot+1, ~serial_to_burn);
-    ememory_otp_pgm_exit();
-    uart_puts(uart, "Resuming boot\r\n");
-    serial = serial_to_burn;
-  }
-
-  ememory_otp_power_down_sequence();
-
-  // SiFive MA-S MAC block; default to serial 0
-  unsigned char mac[6] = { 0x70, 0xb3, 0xd5, 0x92, 0xf0, 0x00 };
-  if (serial != ~0) {
-    mac[5] |= (serial >>  0) & 0xff;
-    mac[4] |= (serial >>  8) & 0xff;
-    mac[3] |= (serial >> 16) & 0xff;
-  }
-  fdt_set_prop(dtb_target, "local-mac-address", &mac[0]);
-#endif
-  uart_puts(uart, "\r\n");
-#endif
-
-  puts("Loading boot payload");
-  ux00boot_load_gpt_partition((void*) PAYLOAD_DEST, &gpt_guid_sifive_bare_metal);
+  hartjob_release();
 
   puts("\r\n\n");
-  slave_main(0, dtb);
+  slave_main(0, boot_dtb);
 #endif
 
   //dead code 
@@ -408,9 +745,17 @@ int main(int id, unsigned long dtb)
 int slave_main(int id, unsigned long dtb)
 {
 #ifdef BOARD_SETUP
+#ifdef DDR_BENCH
+  hartjob_worker_loop();
+#endif
   while (1)
     ;
 #else
+  // Help the boot hart until the payload is loaded
+  if (id != NONSMP_HART) {
+    hartjob_worker_loop();
+  }
+
   // Wait for the DTB location to become known
   while (!dtb_target) {}
 
@@ -66,20 +66,33 @@ static inline void ux00ddr_writeregmap(size_t ahbregaddr, const uint32_t *ctlset
   phy_reset(ddrphyreg, physettings);
 }
 
-static inline void ux00ddr_start(size_t ahbregaddr, size_t filteraddr, size_t ddrend) {
+static inline void ux00ddr_begin_start(size_t ahbregaddr) {
   // START register at ddrctl register base offset 0
   uint32_t regdata = _REG32(0<<2, ahbregaddr);
   regdata |= 0x1;
   _REG32(0<<2, ahbregaddr) = regdata;
-  // WAIT for initialization complete : bit 8 of INT_STATUS (DENALI_CTL_132) 0x210
-  while ((_REG32(132<<2, ahbregaddr) & (1<<MC_INIT_COMPLETE_OFFSET)) == 0) {}
+}
+
+static inline bool ux00ddr_init_complete(size_t ahbregaddr) {
+  // Initialization complete : bit 8 of INT_STATUS (DENALI_CTL_132) 0x210
+  return (_REG32(132<<2, ahbregaddr) & (1<<MC_INIT_COMPLETE_OFFSET)) != 0;
+}
 
+static inline void ux00ddr_open_filter(size_t filteraddr, size_t ddrend) {
   // Disable the BusBlocker in front of the controller AXI slave ports
   volatile uint64_t *filterreg = (volatile uint64_t *)filteraddr;
   filterreg[0] = 0x0f00000000000000UL | (ddrend >> 2);
   //                ^^ RWX + TOR
 }
 
+// Start the controller and wait for training to finish. Callers with other
+// work to do can use the three steps above and keep busy in between.
+static inline void ux00ddr_start(size_t ahbregaddr, size_t filteraddr, size_t ddrend) {
+  ux00ddr_begin_start(ahbregaddr);
+  while (!ux00ddr_init_complete(ahbregaddr)) {}
+  ux00ddr_open_filter(filteraddr, ddrend);
+}
+
 static inline void ux00ddr_mask_mc_init_complete_interrupt(size_t ahbregaddr) {
   // Mask off Bit 8 of Interrupt Status
   // Bit [8] The MC initialization has been completed
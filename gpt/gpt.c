@@ -43,12 +43,7 @@ const gpt_guid gpt_guid_sifive_bare_metal = {{
 
 static inline bool guid_equal(const gpt_guid* a, const gpt_guid* b)
 {
-  for (int i = 0; i < GPT_GUID_SIZE; i++) {
-    if (a->bytes[i] != b->bytes[i]) {
-      return false;
-    }
-  }
-  return true;
+  return a->words[0] == b->words[0] && a->words[1] == b->words[1];
 }
 
 
@@ -71,3 +66,41 @@ gpt_partition_range gpt_find_partition_by_guid(const void* entries, const gpt_gu
   }
   return (gpt_partition_range) { .first_lba = 0, .last_lba = 0 };
 }
+
+
+/**
+ * Resolve several partition type GUIDs in one pass over a block of partition
+ * entries.
+ *
+ * ranges[i] is filled in for guids[i] from the first matching entry, and left
+ * alone if it is already valid, so the entry array can be fed in one block at
+ * a time. Callers start with every range set to gpt_invalid_partition_range().
+ * Returns how many of the ranges are valid.
+ */
+uint32_t gpt_find_partitions_by_guid(
+  const void* entries,
+  uint32_t num_entries,
+  const gpt_guid* const* guids,
+  gpt_partition_range* ranges,
+  uint32_t num_guids
+)
+{
+  gpt_partition_entry* gpt_entries = (gpt_partition_entry*) entries;
+  uint32_t num_found = 0;
+  for (uint32_t g = 0; g < num_guids; g++) {
+    num_found += gpt_is_valid_partition_range(ranges[g]);
+  }
+  for (uint32_t i = 0; i < num_entries && num_found < num_guids; i++) {
+    for (uint32_t g = 0; g < num_guids; g++) {
+      if (!gpt_is_valid_partition_range(ranges[g]) &&
+          guid_equal(&gpt_entries[i].partition_type_guid, guids[g])) {
+        ranges[g] = (gpt_partition_range) {
+          .first_lba = gpt_entries[i].first_lba,
+          .last_lba = gpt_entries[i].last_lba,
+        };
+        num_found++;
+      }
+    }
+  }
+  return num_found;
+}
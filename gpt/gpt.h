@@ -15,10 +15,17 @@
 
 #define GPT_HEADER_LBA 1
 #define GPT_HEADER_BYTES 92
-
-typedef struct
+// "EFI PART"
+#define GPT_SIGNATURE 0x5452415020494645UL
+// The only partition entry layout the lookups below understand
+#define GPT_PARTITION_ENTRY_SIZE 128
+
+// The word view lets GUIDs be compared 64 bits at a time; every GUID in the
+// GPT header and partition entries is 8-byte aligned.
+typedef union
 {
   uint8_t bytes[GPT_GUID_SIZE];
+  uint64_t words[GPT_GUID_SIZE / sizeof(uint64_t)];
 } gpt_guid;
 
 
@@ -63,6 +70,13 @@ typedef struct
 
 
 gpt_partition_range gpt_find_partition_by_guid(const void* entries, const gpt_guid* guid, uint32_t num_entries);
+uint32_t gpt_find_partitions_by_guid(
+  const void* entries,
+  uint32_t num_entries,
+  const gpt_guid* const* guids,
+  gpt_partition_range* ranges,
+  uint32_t num_guids
+);
 
 static inline gpt_partition_range gpt_invalid_partition_range()
 {
@@ -74,6 +88,13 @@ static inline int gpt_is_valid_partition_range(gpt_partition_range range)
   return range.first_lba != 0 && range.last_lba != 0;
 }
 
+// Whether the partition entries of header can be searched at all
+static inline int gpt_is_valid_header(const gpt_header* header)
+{
+  return header->signature == GPT_SIGNATURE &&
+    header->partition_entry_size == GPT_PARTITION_ENTRY_SIZE;
+}
+
 #endif /* !__ASSEMBLER__ */
 
 #endif /* _LIBRARIES_GPT_H */
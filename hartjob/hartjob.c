@@ -0,0 +1,177 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sifive/barrier.h>
+#include "hartjob.h"
+
+// everything zero is correct initial state
+//
+// A new generation hands the job to the parked harts. Barrier can't do that
+// part: the boot hart must not block until every worker has arrived, and the
+// workers need fn and arg along with the wakeup. Completion is a plain
+// rendezvous, so it goes through done.
+static struct {
+  _Atomic volatile int checked_in;
+  _Atomic volatile unsigned long generation;
+  Barrier done;
+  _Atomic volatile int released;
+  hartjob_fn fn;
+  void* arg;
+  int num_workers;
+} job;
+
+
+/**
+ * Park a secondary hart waiting for jobs from the boot hart.
+ *
+ * Returns once the boot hart calls hartjob_release().
+ */
+void hartjob_worker_loop(void)
+{
+  int worker = atomic_fetch_add(&job.checked_in, 1);
+  unsigned long seen = 0;
+
+  while (1) {
+    unsigned long gen = atomic_load(&job.generation);
+    if (gen == seen) {
+      if (atomic_load(&job.released)) {
+        return;
+      }
+      continue;
+    }
+    seen = gen;
+    // Harts that checked in after the job was started sit it out
+    if (worker < job.num_workers) {
+      job.fn(job.arg, worker, job.num_workers);
+      Barrier_Wait(&job.done, job.num_workers + 1);
+    }
+  }
+}
+
+
+/**
+ * Number of secondary harts currently waiting for jobs.
+ */
+int hartjob_num_workers(void)
+{
+  return atomic_load(&job.checked_in);
+}
+
+
+/**
+ * Run fn on every checked-in secondary hart without waiting for it to finish.
+ *
+ * Returns the number of harts running the job. If none are available nothing
+ * is started and the caller is expected to do the work itself.
+ */
+int hartjob_start(hartjob_fn fn, void* arg)
+{
+  int n = atomic_load(&job.checked_in);
+  if (n == 0) {
+    return 0;
+  }
+  job.fn = fn;
+  job.arg = arg;
+  job.num_workers = n;
+  atomic_fetch_add(&job.generation, 1);
+  return n;
+}
+
+
+/**
+ * Wait for every hart running the current job to return from it. Must follow
+ * each hartjob_start() that returned nonzero.
+ */
+void hartjob_wait(void)
+{
+  Barrier_Wait(&job.done, job.num_workers + 1);
+}
+
+
+/**
+ * Let secondary harts return from hartjob_worker_loop().
+ */
+void hartjob_release(void)
+{
+  atomic_store(&job.released, 1);
+}
+
+
+//------------------------------------------------------------------------------
+// Parallel memset/memcpy
+//
+// The region is split into one cache-line-aligned slice per hart, the boot
+// hart taking the last one, so no two harts ever write the same line.
+
+typedef struct
+{
+  uint8_t* dst;
+  const uint8_t* src;  // NULL for memset
+  int c;
+  size_t len;
+} hartjob_mem;
+
+static hartjob_mem mem_job;
+
+
+static void mem_slice(const hartjob_mem* m, int part, int num_parts)
+{
+  uintptr_t base = (uintptr_t) m->dst;
+  uintptr_t end = base + m->len;
+  size_t per_part = (m->len / num_parts + HARTJOB_MEM_ALIGN - 1) & ~(size_t) (HARTJOB_MEM_ALIGN - 1);
+  uintptr_t start = (base + part * per_part) & ~(uintptr_t) (HARTJOB_MEM_ALIGN - 1);
+  uintptr_t stop = (base + (part + 1) * per_part) & ~(uintptr_t) (HARTJOB_MEM_ALIGN - 1);
+  if (part == 0) start = base;
+  if (part == num_parts - 1 || stop > end) stop = end;
+  if (start >= stop) return;
+
+  if (m->src) {
+    memcpy((void*) start, m->src + (start - base), stop - start);
+  } else {
+    memset((void*) start, m->c, stop - start);
+  }
+}
+
+
+static void mem_worker(void* arg, int worker, int num_workers)
+{
+  mem_slice((const hartjob_mem*) arg, worker, num_workers + 1);
+}
+
+
+static void* mem_run(void* dst, const void* src, int c, size_t len)
+{
+  hartjob_mem* m = &mem_job;
+  m->dst = (uint8_t*) dst;
+  m->src = (const uint8_t*) src;
+  m->c = c;
+  m->len = len;
+
+  int n = len < HARTJOB_MEM_MIN_BYTES ? 0 : hartjob_start(mem_worker, m);
+  mem_slice(m, n, n + 1);
+  if (n) hartjob_wait();
+  return dst;
+}
+
+
+/**
+ * memset() spread across the boot hart and every waiting secondary hart.
+ */
+void* hartjob_memset(void* dst, int c, size_t len)
+{
+  return mem_run(dst, NULL, c, len);
+}
+
+
+/**
+ * memcpy() spread across the boot hart and every waiting secondary hart.
+ */
+void* hartjob_memcpy(void* dst, const void* src, size_t len)
+{
+  return mem_run(dst, src, 0, len);
+}
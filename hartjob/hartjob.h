@@ -0,0 +1,32 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _LIBRARIES_HARTJOB_H
+#define _LIBRARIES_HARTJOB_H
+
+#ifndef __ASSEMBLER__
+
+// Job run on every participating secondary hart. worker is the hart's index
+// in [0, num_workers).
+typedef void (*hartjob_fn)(void* arg, int worker, int num_workers);
+
+void hartjob_worker_loop(void);
+int hartjob_num_workers(void);
+int hartjob_start(hartjob_fn fn, void* arg);
+void hartjob_wait(void);
+void hartjob_release(void);
+
+// Regions shorter than this are not worth splitting across harts
+#define HARTJOB_MEM_MIN_BYTES (64 * 1024)
+#define HARTJOB_MEM_ALIGN 64  // cache line
+
+#include <stddef.h>
+
+void* hartjob_memset(void* dst, int c, size_t len);
+void* hartjob_memcpy(void* dst, const void* src, size_t len);
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _LIBRARIES_HARTJOB_H */
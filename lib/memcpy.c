@@ -35,6 +35,11 @@ memcpy(void *__restrict aa, const void *__restrict bb, size_t n)
   if (unlikely ((((uintptr_t)a & msk) != ((uintptr_t)b & msk))
 	       || n < sizeof (long)))
     {
+#if !defined(PREFER_SIZE_OVER_SPEED) && !defined(__OPTIMIZE_SIZE__)
+      /* Only reached this long when the alignments differ.  */
+      if (n >= 4 * sizeof (long))
+	goto misaligned;
+#endif
 small:
       if (__builtin_expect (a < end, 1))
 	while (a < end)
@@ -83,4 +88,32 @@ small:
   if (unlikely (a < end))
     goto small;
   return aa;
+
+#if !defined(PREFER_SIZE_OVER_SPEED) && !defined(__OPTIMIZE_SIZE__)
+misaligned:
+  /* Align the destination, then build each destination word from the two
+     aligned source words it straddles.  Only source words holding bytes
+     that are copied get loaded.  Assumes little-endian.  */
+  while ((uintptr_t)a & msk)
+    BODY (a, b, char);
+
+  {
+    unsigned long *ua = (unsigned long *)a;
+    unsigned long *uend = (unsigned long *)((uintptr_t)end & ~msk);
+    unsigned int shift = ((uintptr_t)b & msk) * 8;
+    const unsigned long *ub = (const unsigned long *)((uintptr_t)b & ~msk);
+    unsigned long w0 = *ub++;
+
+    while (ua < uend)
+      {
+	unsigned long w1 = *ub++;
+	*ua++ = (w0 >> shift) | (w1 << (8 * sizeof (long) - shift));
+	w0 = w1;
+      }
+
+    b += (char *)ua - a;
+    a = (char *)ua;
+  }
+  goto small;
+#endif
 }
@@ -0,0 +1,116 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#include <stdint.h>
+#include <string.h>
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH 4
+
+
+typedef struct
+{
+  const volatile uint8_t* src;
+  size_t pos;
+  size_t avail;
+  size_t size;
+  lz4_wait_fn wait;
+  void* ctx;
+} lz4_input;
+
+
+// Make sure src[pos, pos + n) has arrived
+static int lz4_need(lz4_input* in, size_t n)
+{
+  size_t end = in->pos + n;
+  if (end > in->size) return 0;
+  if (end > in->avail) {
+    in->avail = in->wait(in->ctx, end);
+    if (end > in->avail) return 0;
+  }
+  return 1;
+}
+
+
+static int lz4_read_length(lz4_input* in, size_t* len)
+{
+  uint8_t b;
+  do {
+    if (!lz4_need(in, 1)) return LZ4_ERROR_INPUT;
+    b = in->src[in->pos++];
+    *len += b;
+  } while (b == 255);
+  return 0;
+}
+
+
+int lz4_decompress(
+  void* dst,
+  size_t dst_size,
+  size_t* dst_len,
+  const void* src,
+  size_t src_size,
+  lz4_wait_fn wait,
+  void* ctx
+)
+{
+  lz4_input in = {
+    .src = src,
+    .pos = 0,
+    .avail = wait ? 0 : src_size,
+    .size = src_size,
+    .wait = wait,
+    .ctx = ctx,
+  };
+  uint8_t* out = (uint8_t*) dst;
+  size_t op = 0;
+  int error;
+
+  while (in.pos < in.size) {
+    if (!lz4_need(&in, 1)) return LZ4_ERROR_INPUT;
+    uint8_t token = in.src[in.pos++];
+
+    size_t lit_len = token >> 4;
+    if (lit_len == 15) {
+      error = lz4_read_length(&in, &lit_len);
+      if (error) return error;
+    }
+    if (lit_len > dst_size - op) return LZ4_ERROR_OUTPUT;
+    if (!lz4_need(&in, lit_len)) return LZ4_ERROR_INPUT;
+    memcpy(out + op, (const void*) (in.src + in.pos), lit_len);
+    in.pos += lit_len;
+    op += lit_len;
+
+    // The last sequence carries literals only
+    if (in.pos == in.size) break;
+
+    if (!lz4_need(&in, 2)) return LZ4_ERROR_INPUT;
+    size_t offset = in.src[in.pos] | (in.src[in.pos + 1] << 8);
+    in.pos += 2;
+    if (offset == 0 || offset > op) return LZ4_ERROR_OFFSET;
+
+    size_t match_len = token & 0xf;
+    if (match_len == 15) {
+      error = lz4_read_length(&in, &match_len);
+      if (error) return error;
+    }
+    match_len += LZ4_MIN_MATCH;
+    if (match_len > dst_size - op) return LZ4_ERROR_OUTPUT;
+
+    // Matches may overlap the bytes they produce, so copy forwards
+    const uint8_t* match = out + op - offset;
+    if (offset >= match_len) {
+      memcpy(out + op, match, match_len);
+    } else {
+      for (size_t i = 0; i < match_len; i++) {
+        out[op + i] = match[i];
+      }
+    }
+    op += match_len;
+  }
+
+  *dst_len = op;
+  return 0;
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _LIBRARIES_LZ4_H
+#define _LIBRARIES_LZ4_H
+
+#ifndef __ASSEMBLER__
+
+#include <stddef.h>
+
+#define LZ4_ERROR_INPUT 1    // Stream ended in the middle of a sequence
+#define LZ4_ERROR_OUTPUT 2   // Decompressed data does not fit in dst
+#define LZ4_ERROR_OFFSET 3   // Match refers to data before dst
+
+// Called when the decoder needs src bytes up to index needed. Returns how
+// many bytes of src are available now, which is at least needed unless the
+// stream ended early.
+typedef size_t (*lz4_wait_fn)(void* ctx, size_t needed);
+
+/**
+ * Decompress an LZ4 block (no frame header) from src into dst. When wait is
+ * non-NULL src may still be arriving and is consumed as wait() reports it
+ * available; otherwise all src_size bytes must already be present. On
+ * success *dst_len is set to the number of bytes written.
+ */
+int lz4_decompress(
+  void* dst,
+  size_t dst_size,
+  size_t* dst_len,
+  const void* src,
+  size_t src_size,
+  lz4_wait_fn wait,
+  void* ctx
+);
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _LIBRARIES_LZ4_H */
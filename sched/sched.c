@@ -0,0 +1,55 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sched.h"
+
+
+/**
+ * Step every task until all are done.
+ *
+ * Tasks are visited in index order, so earlier tasks win when several are
+ * runnable. A task is runnable once the tasks in its after mask are done and
+ * its wake time has passed. When nothing is runnable the hart spins on the
+ * clkutils ns clock until the earliest deadline.
+ */
+void sched_run(sched_task* tasks, int num_tasks)
+{
+  uint32_t finished = 0;
+  uint32_t all = num_tasks >= SCHED_MAX_TASKS ? ~0U : (1U << num_tasks) - 1;
+
+  for (int i = 0; i < num_tasks; i++) {
+    tasks[i].state = 0;
+    tasks[i].wake = 0;
+    tasks[i].done = tasks[i].step == NULL;
+    if (tasks[i].done) finished |= SCHED_AFTER(i);
+  }
+
+  while (finished != all) {
+    uint64_t now = clkutils_read_ns();
+    uint64_t next = UINT64_MAX;
+    int ran = 0;
+
+    for (int i = 0; i < num_tasks; i++) {
+      sched_task* task = &tasks[i];
+      if (task->done || (task->after & ~finished)) continue;
+      if (task->wake > now) {
+        if (task->wake < next) next = task->wake;
+        continue;
+      }
+      if (task->step(task) == SCHED_DONE) {
+        task->done = 1;
+        finished |= SCHED_AFTER(i);
+      }
+      ran = 1;
+      now = clkutils_read_ns();
+    }
+
+    if (!ran && next != UINT64_MAX) {
+      while (clkutils_read_ns() < next) ;
+    }
+  }
+}
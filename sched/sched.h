@@ -0,0 +1,57 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _LIBRARIES_SCHED_H
+#define _LIBRARIES_SCHED_H
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+#include <clkutils/clkutils.h>
+
+// Step results
+#define SCHED_DONE 0
+#define SCHED_AGAIN 1
+
+// Most tasks one sched_run() call can order with sched_task.after
+#define SCHED_MAX_TASKS 32
+
+typedef struct sched_task sched_task;
+
+// Do the next piece of a task without blocking on hardware. Returns
+// SCHED_DONE when the task is finished, or SCHED_AGAIN to be stepped again,
+// either on the next pass or, via sched_sleep_ns(), after a deadline.
+typedef int (*sched_step_fn)(sched_task* task);
+
+struct sched_task
+{
+  sched_step_fn step;  // NULL for a task that is compiled out
+  uint32_t after;      // mask of task indices that must finish first
+  int state;           // resume point, 0 on the first step
+  uint64_t wake;       // clkutils_read_ns() before which the task is not stepped
+  int done;
+};
+
+#define SCHED_AFTER(i) (1U << (i))
+
+/**
+ * Have the task stepped again no sooner than ns nanoseconds from now.
+ */
+static inline int sched_sleep_ns(sched_task* task, uint64_t ns)
+{
+  task->wake = clkutils_read_ns() + ns;
+  return SCHED_AGAIN;
+}
+
+static inline int sched_sleep_us(sched_task* task, uint64_t us)
+{
+  return sched_sleep_ns(task, us * 1000);
+}
+
+void sched_run(sched_task* tasks, int num_tasks);
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _LIBRARIES_SCHED_H */
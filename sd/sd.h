@@ -14,6 +14,7 @@
 
 #define SD_COPY_ERROR_CMD18 1
 #define SD_COPY_ERROR_CMD18_CRC 2
+#define SD_COPY_ERROR_CMD17 3
 
 #ifndef __ASSEMBLER__
 
@@ -21,8 +22,21 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// Called by sd_copy_stream() as each block arrives; returns one of the
+// SD_BLOCK_* values below
+typedef int (*sd_block_fn)(void* ctx, size_t block, const void* data, uint16_t crc);
+
+#define SD_BLOCK_CONTINUE 0
+#define SD_BLOCK_STOP 1
+#define SD_BLOCK_BAD_CRC 2
+
+extern unsigned long sd_copy_crc_retries;
+
 int sd_init(spi_ctrl* spi);
 int sd_copy(spi_ctrl* spi, void* dst, uint32_t src_lba, size_t size);
+int sd_copy_stream(spi_ctrl* spi, void* dst, uint32_t src_lba, size_t size,
+                   sd_block_fn on_block, void* ctx);
+uint16_t sd_crc16(uint16_t crc, const void* buf, size_t len);
 
 #endif /* !__ASSEMBLER__ */
 
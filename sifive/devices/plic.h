@@ -0,0 +1,19 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+#ifndef _SIFIVE_PLIC_H
+#define _SIFIVE_PLIC_H
+
+
+#define PLIC_PRIORITY(source) (0x0000 + (source) * 4)
+#define PLIC_PENDING(source) (0x1000 + ((source) / 32) * 4)
+#define PLIC_ENABLE(context, source) (0x2000 + (context) * 0x80 + ((source) / 32) * 4)
+#define PLIC_THRESHOLD(context) (0x200000 + (context) * 0x1000)
+#define PLIC_CLAIM(context) (0x200004 + (context) * 0x1000)
+
+// Hart 0 only has an M-mode context
+#define PLIC_CONTEXT_HART0_M 0
+
+#endif /* _SIFIVE_PLIC_H */
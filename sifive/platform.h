@@ -12,6 +12,7 @@
 #include "sifive/devices/ememoryotp.h"
 #include "sifive/devices/gpio.h"
 #include "sifive/devices/i2c.h"
+#include "sifive/devices/plic.h"
 #include "sifive/devices/spi.h"
 #include "sifive/devices/uart.h"
 #include "sifive/devices/ux00prci.h"
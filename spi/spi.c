@@ -4,9 +4,30 @@
 /* See the file LICENSE for further information */
 
 #include <stdint.h>
+#include <encoding.h>
 #include <sifive/platform.h>
 #include "spi.h"
 
+// PLIC source the AXI Quad SPI interrupt is wired to
+#ifndef SPI_PLIC_IRQ
+  #define SPI_PLIC_IRQ SPI_INT_BASE
+#endif
+
+
+#ifndef PREFER_SIZE_OVER_SPEED
+// Whether transfers sleep on the SPI interrupt instead of polling. The state
+// lives in IPIER rather than a variable. Register reads come back
+// byte-swapped.
+static inline int spi_irq_armed(spi_ctrl* spictrl)
+{
+  return ((spictrl->ipier >> 24) & SPI_IRQ_TX_HALF_EMPTY) != 0;
+}
+#else
+// The ZSBL is built for size and always polls
+#define spi_irq_armed(spictrl) 0
+#define spi_irq_wait(spictrl)
+#endif
+
 
 /**
  * Wait until SPI is ready for transmission and transmit byte.
@@ -38,32 +59,241 @@ uint8_t spi_txrx(spi_ctrl* spictrl, uint8_t in)
 }
 
 
+#ifndef PREFER_SIZE_OVER_SPEED
+/**
+ * Wait for the TX FIFO to drain to half full or empty.
+ *
+ * Events already taken are cleared first. The hart then only sleeps if
+ * nothing has arrived in the RX FIFO since and the TX FIFO still holds bytes,
+ * so a DTR-empty or half-empty event is still to come. Otherwise the caller
+ * goes on polling.
+ *
+ * Interrupts stay masked in mstatus, so nothing traps; wfi still returns as
+ * soon as the PLIC raises the external interrupt, which is then claimed and
+ * acknowledged here.
+ */
+static void spi_irq_wait(spi_ctrl* spictrl)
+{
+  // IPISR bits are cleared by writing them back
+  spictrl->ipisr = spictrl->ipisr >> 24;
+  if ((spictrl->ror >> 24) || ((spictrl->sr.raw_bits >> 24) & SPI_SR_TX_EMPTY)) {
+    return;
+  }
+  while (!(read_csr(mip) & MIP_MEIP)) {
+    __asm__ __volatile__ ("wfi");
+  }
+  uint32_t id = PLIC_REG(PLIC_CLAIM(PLIC_CONTEXT_HART0_M));
+  spictrl->ipisr = spictrl->ipisr >> 24;
+  PLIC_REG(PLIC_CLAIM(PLIC_CONTEXT_HART0_M)) = id;
+}
+#endif
+
+
+/**
+ * Transmit and receive a buffer of bytes.
+ *
+ * Rather than handshaking every byte, keep the TX FIFO topped up and drain
+ * whatever has arrived in the RX FIFO in one go. The number of bytes in
+ * flight never exceeds what the RX FIFO can hold, so neither FIFO needs to be
+ * polled for space. After spi_irq_enable() the hart sleeps in wfi while the
+ * FIFOs drain instead of polling the occupancy registers.
+ *
+ * With tx_buf NULL, SPI_FILL_BYTE is sent instead; with rx_buf NULL, received
+ * bytes are dropped. Received bytes are assembled into whole words when
+ * rx_buf is word-aligned.
+ */
+void spi_transfer(spi_ctrl* spictrl, const void* tx_buf, void* rx_buf, size_t len)
+{
+  const uint8_t* tx = (const uint8_t*) tx_buf;
+  uint8_t* rx = (uint8_t*) rx_buf;
+  uint32_t* rxw = (uint32_t*) rx_buf;
+  int word_aligned = rx && ((uintptr_t) rx & 3) == 0;
+  size_t sent = 0;
+  size_t recvd = 0;
+  uint32_t word = 0;
+
+  int irq = spi_irq_armed(spictrl);
+  int woken = 0;
+
+  while (recvd < len) {
+    while (sent < len && sent - recvd < SPI_FIFO_DEPTH - 1) {
+      spictrl->tx = tx ? tx[sent] : SPI_FILL_BYTE;
+      sent++;
+    }
+    unsigned int n = spictrl->ror >> 24;
+    // Sleep at most once per stretch without progress. The last bytes may
+    // arrive after the final TX interrupt, so after waking keep polling.
+    if (n == 0 && irq && !woken) {
+      spi_irq_wait(spictrl);
+      woken = 1;
+      continue;
+    }
+    if (n) woken = 0;
+    for (; n > 0; n--) {
+      uint8_t x = spictrl->rx >> 24;
+      if (word_aligned) {
+        word |= (uint32_t) x << (8 * (recvd & 3));
+        if ((recvd & 3) == 3) {
+          rxw[recvd >> 2] = word;
+          word = 0;
+        }
+      } else if (rx) {
+        rx[recvd] = x;
+      }
+      recvd++;
+    }
+  }
+
+  // Flush a trailing partial word
+  if (word_aligned) {
+    for (size_t i = len & ~(size_t) 3; i < len; i++) {
+      rx[i] = word;
+      word >>= 8;
+    }
+  }
+}
+
+
+/**
+ * Reset the controller and deselect every slave.
+ */
+void xspi_init_hw(spi_ctrl* spi)
+{ // reset
+  int irq = spi_irq_armed(spi);
+
+	/* Reset the SPI device */
+  spi->srr = 0x0a;
+	/* Enable the transmit empty interrupt, which we use to determine
+	 * progress on the transmission.
+	 */
+
+	// 明示的にIPのresetにかかるクロックを稼ぐ
+  __asm__ __volatile__ ("nop; nop; nop; nop;");
+
+  spi->ipier = 0x04;
+	/* Disable the global IPIF interrupt */
+  spi->dgier = 0;
+	/* Deselect the slave on the SPI bus */
+  spi->ssr = 0xffff;
+
+  // The reset also clears the interrupt enables
+  if (irq) {
+    spi->ipier = SPI_IRQ_DTR_EMPTY | SPI_IRQ_TX_HALF_EMPTY;
+    spi->dgier = SPI_DGIER_GIE;
+  }
+}
+
+
+#ifndef PREFER_SIZE_OVER_SPEED
+// Hart 0's PLIC threshold and mie.MEIE from before spi_irq_enable()
+static uint32_t saved_threshold;
+static uintptr_t saved_meie;
+
+/**
+ * Have transfers on hart 0 sleep until the TX FIFO drains rather than
+ * polling. The SPI interrupt is routed to hart 0's M-mode context but kept
+ * masked in mstatus, so it only wakes wfi.
+ *
+ * This only idles hart 0 inside spi_transfer(); the caller still waits for
+ * the transfer to finish, so no other boot work runs meanwhile.
+ */
+void spi_irq_enable(spi_ctrl* spictrl)
+{
+  clear_csr(mstatus, MSTATUS_MIE);
+  saved_threshold = PLIC_REG(PLIC_THRESHOLD(PLIC_CONTEXT_HART0_M));
+  saved_meie = read_csr(mie) & MIP_MEIP;
+  PLIC_REG(PLIC_PRIORITY(SPI_PLIC_IRQ)) = 1;
+  PLIC_REG(PLIC_THRESHOLD(PLIC_CONTEXT_HART0_M)) = 0;
+  PLIC_REG(PLIC_ENABLE(PLIC_CONTEXT_HART0_M, SPI_PLIC_IRQ)) |= 1U << (SPI_PLIC_IRQ % 32);
+  set_csr(mie, MIP_MEIP);
+
+  spictrl->ipisr = spictrl->ipisr >> 24;
+  spictrl->ipier = SPI_IRQ_DTR_EMPTY | SPI_IRQ_TX_HALF_EMPTY;
+  spictrl->dgier = SPI_DGIER_GIE;
+}
+
+
+/**
+ * Undo spi_irq_enable(), leaving the SPI source with priority 0 and hart 0's
+ * threshold and mie.MEIE as they were before it.
+ */
+void spi_irq_disable(spi_ctrl* spictrl)
+{
+  spictrl->dgier = 0;
+  spictrl->ipier = 0x04;
+  PLIC_REG(PLIC_ENABLE(PLIC_CONTEXT_HART0_M, SPI_PLIC_IRQ)) &= ~(1U << (SPI_PLIC_IRQ % 32));
+  PLIC_REG(PLIC_PRIORITY(SPI_PLIC_IRQ)) = 0;
+  PLIC_REG(PLIC_THRESHOLD(PLIC_CONTEXT_HART0_M)) = saved_threshold;
+  if (!saved_meie) clear_csr(mie, MIP_MEIP);
+}
+#endif
+
+
 #define MICRON_SPI_FLASH_CMD_RESET_ENABLE        0x66
 #define MICRON_SPI_FLASH_CMD_MEMORY_RESET        0x99
 #define MICRON_SPI_FLASH_CMD_READ                0x03
 #define MICRON_SPI_FLASH_CMD_QUAD_FAST_READ      0x6b
 
+// Slave select line the boot flash sits on
+#ifndef SPI_FLASH_CS
+  #define SPI_FLASH_CS 0
+#endif
+
+// Quad output fast read needs 8 dummy cycles after the address
+#define MICRON_SPI_FLASH_QUAD_DUMMY_BYTES 1
+
+
+static void spi_flash_select(spi_ctrl* spictrl)
+{
+  // Inhibit, manual slave select, master, enable
+  spictrl->cr.raw_bits = 0x186;
+  spictrl->ssr = ~(1U << SPI_FLASH_CS);
+  spictrl->cr.raw_bits = 0x086;
+}
+
+
+static void spi_flash_deselect(spi_ctrl* spictrl)
+{
+  spictrl->cr.raw_bits = 0x186;
+  spictrl->ssr = 0xffff;
+}
+
+
 /**
  * Copy data from SPI flash without memory-mapped flash.
+ *
+ * SPI_FLASH_READ_QUAD issues a quad output fast read; the AXI Quad SPI has to
+ * be generated in quad mode for the data phase to use all four lanes. The
+ * command, address and dummy bytes go out in one go and the data is then
+ * received in FIFO-sized batches.
  */
-int spi_copy(spi_ctrl* spictrl, void* buf, uint32_t addr, uint32_t size)
+int spi_copy_mode(spi_ctrl* spictrl, void* buf, uint32_t addr, uint32_t size, int mode)
 {
-  uint8_t* buf_bytes = (uint8_t*) buf;
-  spictrl->cr.transaction_inhibit = 1;
-
-  spi_txrx(spictrl, MICRON_SPI_FLASH_CMD_READ);
-  spi_txrx(spictrl, (addr >> 16) & 0xff);
-  spi_txrx(spictrl, (addr >> 8) & 0xff);
-  spi_txrx(spictrl, addr & 0xff);
-
-  for (unsigned int i = 0; i < size; i++) {
-    *buf_bytes = spi_txrx(spictrl, 0);
-    buf_bytes++;
+  uint8_t cmd[4 + MICRON_SPI_FLASH_QUAD_DUMMY_BYTES];
+  unsigned int cmd_len = 4;
+  cmd[0] = MICRON_SPI_FLASH_CMD_READ;
+  cmd[1] = (addr >> 16) & 0xff;
+  cmd[2] = (addr >> 8) & 0xff;
+  cmd[3] = addr & 0xff;
+  if (mode == SPI_FLASH_READ_QUAD) {
+    cmd[0] = MICRON_SPI_FLASH_CMD_QUAD_FAST_READ;
+    for (unsigned int i = 0; i < MICRON_SPI_FLASH_QUAD_DUMMY_BYTES; i++) {
+      cmd[cmd_len++] = 0;
+    }
   }
 
-  spictrl->cr.transaction_inhibit = 0;
+  spi_flash_select(spictrl);
+  spi_transfer(spictrl, cmd, NULL, cmd_len);
+  spi_transfer(spictrl, NULL, buf, size);
+  spi_flash_deselect(spictrl);
   return 0;
 }
 
 
+int spi_copy(spi_ctrl* spictrl, void* buf, uint32_t addr, uint32_t size)
+{
+  return spi_copy_mode(spictrl, buf, addr, size, SPI_FLASH_READ_SINGLE);
+}
+
+
 extern inline unsigned int spi_min_clk_divisor(unsigned int input_khz, unsigned int max_target_khz);
@@ -9,6 +9,24 @@
 #ifndef __ASSEMBLER__
 
 #include <stdint.h>
+#include <stddef.h>
+
+// Depth of the AXI Quad SPI transmit and receive FIFOs
+#define SPI_FIFO_DEPTH 16
+// Sent by spi_transfer() when there is nothing to transmit
+#define SPI_FILL_BYTE 0xFF
+
+// AXI Quad SPI interrupt status/enable bits (IPISR, IPIER)
+#define SPI_IRQ_DTR_EMPTY (1 << 2)
+#define SPI_IRQ_TX_HALF_EMPTY (1 << 6)
+// Global interrupt enable (DGIER)
+#define SPI_DGIER_GIE (1U << 31)
+// Status register (SR) bits
+#define SPI_SR_TX_EMPTY (1 << 2)
+
+// spi_copy_mode() read modes
+#define SPI_FLASH_READ_SINGLE 0
+#define SPI_FLASH_READ_QUAD 1
 
 #define _ASSERT_SIZEOF(type, size) _Static_assert(sizeof(type) == (size), #type " must be " #size " bytes wide")
 
@@ -307,7 +325,13 @@ typedef volatile struct
 void spi_tx(spi_ctrl* spictrl, uint8_t in);
 uint8_t spi_rx(spi_ctrl* spictrl);
 uint8_t spi_txrx(spi_ctrl* spictrl, uint8_t in);
+void xspi_init_hw(spi_ctrl* spi);
+// Not in builds with PREFER_SIZE_OVER_SPEED, i.e. the ZSBL
+void spi_irq_enable(spi_ctrl* spictrl);
+void spi_irq_disable(spi_ctrl* spictrl);
+void spi_transfer(spi_ctrl* spictrl, const void* tx_buf, void* rx_buf, size_t len);
 int spi_copy(spi_ctrl* spictrl, void* buf, uint32_t addr, uint32_t size);
+int spi_copy_mode(spi_ctrl* spictrl, void* buf, uint32_t addr, uint32_t size, int mode);
 
 
 // Inlining header functions in C
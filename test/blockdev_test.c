@@ -0,0 +1,141 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+/*
+ * Exercises the block device layer over a RAM-disk: byte-range reads against
+ * the backing memory, the read-ahead cache at the end of the device, the
+ * range errors past it and device errors during read-ahead. Then times
+ * loading an image through the cache against a straight memcpy of the same
+ * bytes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <blockdev/blockdev.h>
+
+#define BLOCK_SIZE 512
+#define DISK_BLOCKS 32768  // 16 MiB
+#define CACHE_BLOCKS 8
+#define IMAGE_BLOCKS 16384
+#define BENCH_ROUNDS 32
+
+
+static int (*memory_read_blocks)(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks);
+static size_t device_reads;
+static size_t device_blocks;
+static int fail_multi_block;
+
+#define TEST_DEVICE_ERROR 0x42
+
+static int counting_read_blocks(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks)
+{
+  device_reads++;
+  device_blocks += num_blocks;
+  if (fail_multi_block && num_blocks > 1) return TEST_DEVICE_ERROR;
+  return memory_read_blocks(dev, dst, lba, num_blocks);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+int main(void)
+{
+  static uint8_t cache_buf[CACHE_BLOCKS * BLOCK_SIZE];
+  uint8_t* disk = malloc((size_t) DISK_BLOCKS * BLOCK_SIZE);
+  uint8_t* dst = malloc((size_t) IMAGE_BLOCKS * BLOCK_SIZE);
+  blockdev dev;
+  blockdev_cache cache;
+  const uint8_t* data;
+  int failures = 0;
+
+  srand(1);
+  for (size_t i = 0; i < (size_t) DISK_BLOCKS * BLOCK_SIZE; i++) disk[i] = rand();
+  blockdev_init_memory(&dev, disk, BLOCK_SIZE, DISK_BLOCKS);
+  memory_read_blocks = dev.read_blocks;
+  dev.read_blocks = counting_read_blocks;
+  blockdev_cache_init(&cache, &dev, cache_buf, CACHE_BLOCKS);
+
+  // Arbitrary byte ranges, partial blocks at either end included
+  for (int i = 0; i < 10000; i++) {
+    uint64_t offset = rand() % ((uint64_t) DISK_BLOCKS * BLOCK_SIZE - 8192);
+    uint64_t len = rand() % 8192;
+    memset(dst, 0, len);
+    CHECK(blockdev_read_bytes(&cache, dst, offset, len) == 0);
+    CHECK(memcmp(dst, disk + offset, len) == 0);
+  }
+
+  // Read-ahead fills the cache, and the blocks after come from it
+  blockdev_cache_init(&cache, &dev, cache_buf, CACHE_BLOCKS);
+  device_reads = device_blocks = 0;
+  CHECK(blockdev_cache_get(&cache, 100, &data) == 0 && memcmp(data, disk + 100 * BLOCK_SIZE, BLOCK_SIZE) == 0);
+  CHECK(blockdev_cache_get(&cache, 100 + CACHE_BLOCKS - 1, &data) == 0);
+  CHECK(device_reads == 1 && device_blocks == CACHE_BLOCKS);
+
+  // No read-ahead for single blocks
+  device_reads = device_blocks = 0;
+  CHECK(blockdev_cache_get_single(&cache, 1, &data) == 0 && memcmp(data, disk + BLOCK_SIZE, BLOCK_SIZE) == 0);
+  CHECK(device_reads == 1 && device_blocks == 1);
+
+  // Read-ahead stops at the end of the device, and nothing past it is read
+  device_reads = device_blocks = 0;
+  CHECK(blockdev_cache_get(&cache, DISK_BLOCKS - 1, &data) == 0);
+  CHECK(memcmp(data, disk + (DISK_BLOCKS - 1) * BLOCK_SIZE, BLOCK_SIZE) == 0);
+  CHECK(device_blocks == 1);
+  device_reads = 0;
+  CHECK(blockdev_cache_get(&cache, DISK_BLOCKS, &data) == BLOCKDEV_ERROR_RANGE);
+  CHECK(blockdev_cache_get(&cache, UINT64_MAX, &data) == BLOCKDEV_ERROR_RANGE);
+  CHECK(blockdev_read(&cache, dst, DISK_BLOCKS - 1, 2) == BLOCKDEV_ERROR_RANGE);
+  CHECK(blockdev_read(&cache, dst, UINT64_MAX, 2) == BLOCKDEV_ERROR_RANGE);
+  CHECK(blockdev_read_bytes(&cache, dst, (uint64_t) DISK_BLOCKS * BLOCK_SIZE - 10, 20) == BLOCKDEV_ERROR_RANGE);
+  CHECK(device_reads == 0);
+  CHECK(BLOCKDEV_ERROR_RANGE < 0);
+
+  // A failed read-ahead is reported as is, not retried as a single block, and
+  // leaves nothing cached
+  blockdev_cache_init(&cache, &dev, cache_buf, CACHE_BLOCKS);
+  device_reads = 0;
+  fail_multi_block = 1;
+  CHECK(blockdev_cache_get(&cache, 200, &data) == TEST_DEVICE_ERROR);
+  CHECK(device_reads == 1 && cache.num_valid == 0);
+  CHECK(blockdev_cache_get_single(&cache, 200, &data) == 0);
+  CHECK(memcmp(data, disk + 200 * BLOCK_SIZE, BLOCK_SIZE) == 0);
+  fail_multi_block = 0;
+
+  // An image as the loader reads it: header block through the cache, the rest
+  // in one bulk read
+  double t = now();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    blockdev_cache_init(&cache, &dev, cache_buf, CACHE_BLOCKS);
+    CHECK(blockdev_cache_get(&cache, 1024, &data) == 0);
+    CHECK(blockdev_read(&cache, dst, 1024, IMAGE_BLOCKS) == 0);
+  }
+  double t_dev = now() - t;
+  CHECK(memcmp(dst, disk + 1024 * BLOCK_SIZE, (size_t) IMAGE_BLOCKS * BLOCK_SIZE) == 0);
+  t = now();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    memcpy(dst, disk + 1024 * BLOCK_SIZE, (size_t) IMAGE_BLOCKS * BLOCK_SIZE);
+    __asm__ volatile("" ::: "memory");
+  }
+  double t_copy = now() - t;
+
+  double mb = (double) BENCH_ROUNDS * IMAGE_BLOCKS * BLOCK_SIZE / 1e6;
+  printf("ramdisk %d KiB image: blockdev %.0f MB/s, memcpy %.0f MB/s\n",
+         IMAGE_BLOCKS * BLOCK_SIZE / 1024, mb / t_dev, mb / t_copy);
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  free(disk);
+  free(dst);
+  return failures != 0;
+}
@@ -0,0 +1,81 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+/*
+ * Runs the hartjob dispatcher with threads standing in for the secondary
+ * harts: many back-to-back jobs, so a lost or doubled completion hangs or
+ * fails, and the parallel memset/memcpy at sizes around the slice boundaries.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <hartjob/hartjob.h>
+
+#define NUM_WORKERS 4
+#define NUM_JOBS 200
+#define MAX_LEN (1 << 20)
+
+static _Atomic int job_runs[NUM_WORKERS];
+
+static void* worker_main(void* arg)
+{
+  hartjob_worker_loop();
+  return NULL;
+}
+
+static void count_job(void* arg, int worker, int num_workers)
+{
+  atomic_fetch_add(&job_runs[worker], 1);
+}
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+int main(void)
+{
+  static uint8_t src[MAX_LEN + 128], dst[MAX_LEN + 128], exp[MAX_LEN + 128];
+  pthread_t threads[NUM_WORKERS];
+  int failures = 0;
+
+  for (int i = 0; i < NUM_WORKERS; i++) pthread_create(&threads[i], NULL, worker_main, NULL);
+  while (hartjob_num_workers() < NUM_WORKERS) ;
+
+  for (int i = 0; i < NUM_JOBS; i++) {
+    int n = hartjob_start(count_job, NULL);
+    CHECK(n == NUM_WORKERS);
+    hartjob_wait();
+  }
+  for (int i = 0; i < NUM_WORKERS; i++) CHECK(atomic_load(&job_runs[i]) == NUM_JOBS);
+
+  srand(1);
+  for (size_t i = 0; i < sizeof(src); i++) src[i] = rand();
+  static const size_t lens[] = {
+    0, 1, HARTJOB_MEM_MIN_BYTES - 1, HARTJOB_MEM_MIN_BYTES, HARTJOB_MEM_MIN_BYTES + 63,
+    100000, 262143, MAX_LEN,
+  };
+  for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+    for (size_t off = 0; off < 128; off += 17) {
+      size_t len = lens[l] - (lens[l] == MAX_LEN ? off : 0);
+      memset(dst, 0x5a, sizeof(dst));
+      memcpy(exp, dst, sizeof(dst));
+      memcpy(exp + off, src, len);
+      hartjob_memcpy(dst + off, src, len);
+      CHECK(memcmp(dst, exp, sizeof(dst)) == 0);
+      memset(exp + off, 0xc3, len);
+      hartjob_memset(dst + off, 0xc3, len);
+      CHECK(memcmp(dst, exp, sizeof(dst)) == 0);
+    }
+  }
+
+  hartjob_release();
+  for (int i = 0; i < NUM_WORKERS; i++) pthread_join(threads[i], NULL);
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures != 0;
+}
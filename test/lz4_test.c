@@ -0,0 +1,185 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+/*
+ * Decodes hand-built LZ4 blocks: literal-only, extended lengths, overlapping
+ * matches and several sequences. Each one is decoded whole and again through
+ * the wait callback with the input arriving a few bytes at a time, the way
+ * the loader feeds it from the SD stream. Then the malformed blocks.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <lz4/lz4.h>
+
+#define MAX_OUT 1024
+
+// Bytes of the block copied to the staging buffer so far, like blocks landing
+// behind the decoder
+typedef struct
+{
+  const uint8_t* src;
+  uint8_t* staging;
+  size_t size;
+  size_t avail;
+  size_t step;
+  size_t stop;  // stream ends early here
+  int calls;
+} lz4_feed;
+
+static size_t feed_wait(void* ctx, size_t needed)
+{
+  lz4_feed* f = (lz4_feed*) ctx;
+  f->calls++;
+  while (f->avail < needed && f->avail < f->stop) {
+    size_t n = f->stop - f->avail < f->step ? f->stop - f->avail : f->step;
+    memcpy(f->staging + f->avail, f->src + f->avail, n);
+    f->avail += n;
+  }
+  return f->avail;
+}
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+static void check_case(const char* name, const uint8_t* data, size_t size,
+                       const uint8_t* expected, size_t expected_size)
+{
+  static uint8_t out[MAX_OUT + 16];
+  static uint8_t staging[MAX_OUT];
+  size_t out_len;
+
+  memset(out, 0xa5, sizeof(out));
+  int rc = lz4_decompress(out, MAX_OUT, &out_len, data, size, NULL, NULL);
+  if (rc || out_len != expected_size || memcmp(out, expected, expected_size)) {
+    printf("FAIL: %s: whole rc %d len %zu\n", name, rc, out_len);
+    failures++;
+  }
+
+  // Exactly sized output must fit, one byte less must not
+  rc = lz4_decompress(out, expected_size, &out_len, data, size, NULL, NULL);
+  CHECK(rc == 0 && out_len == expected_size);
+  if (expected_size) {
+    CHECK(lz4_decompress(out, expected_size - 1, &out_len, data, size, NULL, NULL) == LZ4_ERROR_OUTPUT);
+  }
+
+  for (size_t step = 1; step <= 7; step++) {
+    lz4_feed f = { data, staging, size, 0, step, size, 0 };
+    memset(staging, 0xee, sizeof(staging));
+    memset(out, 0xa5, sizeof(out));
+    rc = lz4_decompress(out, MAX_OUT, &out_len, staging, size, feed_wait, &f);
+    if (rc || out_len != expected_size || memcmp(out, expected, expected_size) ||
+        (size > step && f.calls < 2)) {
+      printf("FAIL: %s: step %zu rc %d len %zu calls %d\n", name, step, rc, out_len, f.calls);
+      failures++;
+    }
+  }
+
+  // Every early end of the stream is caught rather than decoded from stale
+  // staging bytes
+  for (size_t stop = 0; stop < size; stop++) {
+    lz4_feed f = { data, staging, size, 0, 3, stop, 0 };
+    memset(staging, 0xee, sizeof(staging));
+    rc = lz4_decompress(out, MAX_OUT, &out_len, staging, size, feed_wait, &f);
+    if (rc != LZ4_ERROR_INPUT) {
+      printf("FAIL: %s: stopped at %zu rc %d\n", name, stop, rc);
+      failures++;
+    }
+  }
+}
+
+#define CASE(name, expected, expected_size, ...) do { \
+    static const uint8_t block[] = { __VA_ARGS__ }; \
+    check_case(name, block, sizeof(block), (const uint8_t*) (expected), expected_size); \
+  } while (0)
+
+int main(void)
+{
+  uint8_t exp[MAX_OUT];
+
+  CASE("literals", "hello", 5,
+       0x50, 'h', 'e', 'l', 'l', 'o');
+
+  // 15 in the token plus 5 in an extension byte
+  CASE("long literals", "abcdefghijklmnopqrst", 20,
+       0xf0, 5, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j',
+       'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't');
+
+  // 15 + 255 + 30: the extension carries on past a 255 byte
+  for (int i = 0; i < 300; i++) exp[i] = 'A' + i % 26;
+  {
+    static uint8_t block[3 + 300];
+    block[0] = 0xf0;
+    block[1] = 255;
+    block[2] = 30;
+    memcpy(block + 3, exp, 300);
+    check_case("literal length over 255", block, sizeof(block), exp, 300);
+  }
+
+  // Offset 1 repeats the last byte: run-length
+  CASE("offset 1 run", "aaaaaaaaaaaxyz", 14,
+       0x16, 'a', 0x01, 0x00,
+       0x30, 'x', 'y', 'z');
+
+  // Offset 3 under a 9-byte match reads bytes the match itself writes
+  CASE("overlapping match", "abcabcabcabc!", 13,
+       0x35, 'a', 'b', 'c', 0x03, 0x00,
+       0x10, '!');
+
+  // Match length 4 + 15 + 255 + 3 = 277 at offset 2
+  for (int i = 0; i < 279; i++) exp[i] = "ab"[i % 2];
+  CASE("long overlapping match", exp, 279,
+       0x2f, 'a', 'b', 0x02, 0x00, 255, 3);
+
+  // Non-overlapping matches reaching back across earlier sequences, with a
+  // two-byte offset
+  memset(exp, 0, sizeof(exp));
+  memcpy(exp, "0123456789abcdef", 16);
+  memcpy(exp + 16, "4567", 4);
+  memset(exp + 20, '-', 260);
+  memcpy(exp + 280, "0123", 4);
+  memcpy(exp + 284, "end", 3);
+  CASE("several sequences", exp, 287,
+       0xf0, 1, '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+       12, 0x00,
+       0x1f, '-', 0x01, 0x00, 240,
+       0x00, 0x18, 0x01,
+       0x30, 'e', 'n', 'd');
+
+  CASE("empty", "", 0);
+
+  size_t out_len;
+  static uint8_t out[MAX_OUT];
+  {
+    static const uint8_t block[] = { 0x14, 'a', 0x00, 0x00, 0x10, 'b' };
+    CHECK(lz4_decompress(out, MAX_OUT, &out_len, block, sizeof(block), NULL, NULL) == LZ4_ERROR_OFFSET);
+  }
+  {
+    static const uint8_t block[] = { 0x24, 'a', 'b', 0x03, 0x00, 0x10, 'b' };
+    CHECK(lz4_decompress(out, MAX_OUT, &out_len, block, sizeof(block), NULL, NULL) == LZ4_ERROR_OFFSET);
+  }
+  {
+    // Literal run longer than what is left of the block
+    static const uint8_t block[] = { 0x50, 'a', 'b' };
+    CHECK(lz4_decompress(out, MAX_OUT, &out_len, block, sizeof(block), NULL, NULL) == LZ4_ERROR_INPUT);
+  }
+  {
+    // Block ends inside a match offset
+    static const uint8_t block[] = { 0x14, 'a', 0x01 };
+    CHECK(lz4_decompress(out, MAX_OUT, &out_len, block, sizeof(block), NULL, NULL) == LZ4_ERROR_INPUT);
+  }
+  {
+    // Block ends inside a length extension
+    static const uint8_t block[] = { 0x1f, 'a', 0x01, 0x00, 255 };
+    CHECK(lz4_decompress(out, MAX_OUT, &out_len, block, sizeof(block), NULL, NULL) == LZ4_ERROR_INPUT);
+  }
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures != 0;
+}
@@ -0,0 +1,82 @@
+/* Copyright (c) 2018 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* See the file LICENSE for further information */
+
+/*
+ * Fuzzes lib/memcpy.c (built as boot_memcpy) over every source and
+ * destination alignment, checking the copy and the bytes around it, then
+ * times aligned and misaligned copies against a plain byte loop.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_LEN 1024
+#define PAD 32
+#define BENCH_LEN 4096
+#define BENCH_BYTES (256 << 20)
+
+void* boot_memcpy(void* __restrict aa, const void* __restrict bb, size_t n);
+
+static void* byte_memcpy(void* __restrict aa, const void* __restrict bb, size_t n)
+{
+  volatile char* a = aa;
+  const char* b = bb;
+  while (n--) *a++ = *b++;
+  return aa;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double bench(void* (*copy)(void* __restrict, const void* __restrict, size_t),
+                    char* dst, const char* src)
+{
+  double t = now();
+  for (size_t n = 0; n < BENCH_BYTES; n += BENCH_LEN) {
+    copy(dst, src, BENCH_LEN);
+    __asm__ volatile("" ::: "memory");
+  }
+  return BENCH_BYTES / (now() - t) / 1e6;
+}
+
+int main(void)
+{
+  static _Alignas(64) char src[MAX_LEN + 2 * PAD];
+  static _Alignas(64) char dst[MAX_LEN + 2 * PAD];
+  static _Alignas(64) char exp[MAX_LEN + 2 * PAD];
+  static _Alignas(64) char big_src[BENCH_LEN + 64];
+  static _Alignas(64) char big_dst[BENCH_LEN + 64];
+  int failures = 0;
+
+  srand(1);
+  for (size_t i = 0; i < sizeof(src); i++) src[i] = rand();
+
+  for (size_t s = 0; s < 16; s++) {
+    for (size_t d = 0; d < 16; d++) {
+      for (size_t len = 0; len <= MAX_LEN; len += (len < 128) ? 1 : 1 + rand() % 37) {
+        for (size_t i = 0; i < sizeof(dst); i++) dst[i] = exp[i] = rand();
+        memmove(exp + PAD + d, src + PAD + s, len);
+        void* ret = boot_memcpy(dst + PAD + d, src + PAD + s, len);
+        if (ret != dst + PAD + d || memcmp(dst, exp, sizeof(dst))) {
+          if (failures++ < 10) printf("FAIL: src +%zu dst +%zu len %zu\n", s, d, len);
+        }
+      }
+    }
+  }
+
+  printf("memcpy %d bytes: aligned %.0f MB/s (byte loop %.0f MB/s), "
+         "misaligned %.0f MB/s (byte loop %.0f MB/s)\n", BENCH_LEN,
+         bench(boot_memcpy, big_dst, big_src), bench(byte_memcpy, big_dst, big_src),
+         bench(boot_memcpy, big_dst + 1, big_src + 3), bench(byte_memcpy, big_dst + 1, big_src + 3));
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures != 0;
+}
@@ -13,11 +13,62 @@
 #include <uart/uart.h>
 #include <gpt/gpt.h>
 #include <sd/sd.h>
+#include <blockdev/blockdev.h>
+#include <hartjob/hartjob.h>
+#include <lz4/lz4.h>
+#include <elf/elf.h>
+#include <dma/dma.h>
 #include "ux00boot.h"
 
 
+// Boot devices selectable with UX00BOOT_BOOT_DEVICE
+#define UX00BOOT_DEVICE_SD 0
+#define UX00BOOT_DEVICE_SPI_FLASH 1
+#define UX00BOOT_DEVICE_MMAP_FLASH 2
+#define UX00BOOT_DEVICE_RAMDISK 3
+
+#ifndef UX00BOOT_BOOT_DEVICE
+  #define UX00BOOT_BOOT_DEVICE UX00BOOT_DEVICE_SD
+#endif
+
+// A GPT image already in memory, e.g. put in DDR by a debugger
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_RAMDISK
+  #ifndef UX00BOOT_RAMDISK_ADDR
+    #error "UX00BOOT_RAMDISK_ADDR must be set to boot from a RAM-disk"
+  #endif
+  #ifndef UX00BOOT_RAMDISK_BLOCKS
+    #define UX00BOOT_RAMDISK_BLOCKS 0
+  #endif
+#endif
+
+// Define UX00BOOT_SPI_FLASH_QUAD for SPI flash boot when the AXI Quad SPI is
+// generated in quad mode and the flash supports quad output fast read
+
+// Define UX00BOOT_SPI_IRQ to have hart 0 sleep in wfi while the SPI FIFOs
+// drain during SD or SPI flash reads instead of polling them (fsbl only).
+// This idles the hart rather than freeing it: the read still blocks, and the
+// fsbl scheduler runs nothing else until it returns.
+
+// Blocks read ahead by sub-block and single-block reads
+#ifndef UX00BOOT_CACHE_BLOCKS
+  #define UX00BOOT_CACHE_BLOCKS 8
+#endif
+
 #define GPT_BLOCK_SIZE 512
 
+// Received block CRCs waiting for a secondary hart to check them
+#define SD_CRC_RING_SIZE 256
+// Failed blocks remembered for re-reading before giving up on the whole range
+#define SD_MAX_BAD_BLOCKS 16
+// Partition entries are streamed into a scratch area this many blocks at a
+// time; 32 blocks hold the standard table of 128 entries of 128 bytes
+#define GPT_ENTRIES_SCRATCH_BLOCKS 32
+// Compressed images are staged in DDR just past the end of the decompressed
+// image, rounded up to this
+#define LZ4_STAGING_ALIGN 0x1000
+// Most program headers an ELF payload may have
+#define ELF_MAX_PHDRS 16
+
 // Bit fields of error codes
 #define ERROR_CODE_BOOTSTAGE (0xfUL << 60)
 #define ERROR_CODE_TRAP (0xfUL << 56)
@@ -38,6 +89,17 @@
 #define ERROR_CODE_SD_CARD_CMD18 0xa
 #define ERROR_CODE_SD_CARD_CMD18_CRC 0xb
 #define ERROR_CODE_SD_CARD_UNEXPECTED_ERROR 0xc
+#define ERROR_CODE_SD_CARD_CMD17 0xd
+#define ERROR_CODE_TOO_MANY_PARTITIONS 0xe
+#define ERROR_CODE_IMAGE_LOAD_ADDR 0xf
+#define ERROR_CODE_IMAGE_TOO_LARGE 0x10
+#define ERROR_CODE_IMAGE_CHECKSUM 0x11
+#define ERROR_CODE_IMAGE_UNSUPPORTED 0x12
+#define ERROR_CODE_IMAGE_DECOMPRESS 0x13
+#define ERROR_CODE_ELF_ENTRY 0x14
+#define ERROR_CODE_ELF_TOO_MANY_SEGMENTS 0x15
+#define ERROR_CODE_BLOCK_OUT_OF_RANGE 0x16
+#define ERROR_CODE_GPT_INVALID_HEADER 0x17
 
 // error LED not implemented
 // We are assuming that an error LED is connected to the GPIO pin
@@ -49,10 +111,23 @@
 // UX00 boot routine functions
 //==============================================================================
 
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD
+
 //------------------------------------------------------------------------------
 // SD Card
 //------------------------------------------------------------------------------
 
+static int decode_sd_copy_error(int error)
+{
+  switch (error) {
+    case SD_COPY_ERROR_CMD18: return ERROR_CODE_SD_CARD_CMD18;
+    case SD_COPY_ERROR_CMD18_CRC: return ERROR_CODE_SD_CARD_CMD18_CRC;
+    case SD_COPY_ERROR_CMD17: return ERROR_CODE_SD_CARD_CMD17;
+    default: return ERROR_CODE_SD_CARD_UNEXPECTED_ERROR;
+  }
+}
+
+
 static int initialize_sd(spi_ctrl* spictrl)
 {
   int error = sd_init(spictrl);
@@ -70,196 +145,695 @@ static int initialize_sd(spi_ctrl* spictrl)
   return 0;
 }
 
-static gpt_partition_range find_sd_gpt_partition(
-  spi_ctrl* spictrl,
-  uint64_t partition_entries_lba,
-  uint32_t num_partition_entries,
-  uint32_t partition_entry_size,
-  const gpt_guid* partition_type_guid,
-  void* block_buf  // Used to temporarily load blocks of SD card
-)
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SPI_FLASH
+
+//------------------------------------------------------------------------------
+// SPI flash
+//------------------------------------------------------------------------------
+
+// SPI_FLASH_READ_SINGLE or SPI_FLASH_READ_QUAD
+static int spi_flash_read_mode;
+
+
+/**
+ * Set up SPI for direct, non-memory-mapped access.
+ */
+static void initialize_spi_flash(spi_ctrl* spictrl)
 {
-  // Exclusive end
-  uint64_t partition_entries_lba_end = (
-    partition_entries_lba +
-    (num_partition_entries * partition_entry_size + GPT_BLOCK_SIZE - 1) / GPT_BLOCK_SIZE
-  );
-  for (uint64_t i = partition_entries_lba; i < partition_entries_lba_end; i++) {
-    sd_copy(spictrl, block_buf, i, 1);
-    gpt_partition_range range = gpt_find_partition_by_guid(
-      block_buf, partition_type_guid, GPT_BLOCK_SIZE / partition_entry_size
-    );
-    if (gpt_is_valid_partition_range(range)) {
-      return range;
+  // SCK is fixed by how the AXI Quad SPI was generated; flash reads need it
+  // at 10MHz or below
+  xspi_init_hw(spictrl);
+
+  spi_flash_read_mode = SPI_FLASH_READ_SINGLE;
+#ifdef UX00BOOT_SPI_FLASH_QUAD
+  // Only read over four lanes if the GPT header comes back intact that way
+  {
+    gpt_header header;
+    spi_copy_mode(spictrl, &header, GPT_HEADER_LBA * GPT_BLOCK_SIZE, sizeof(header), SPI_FLASH_READ_QUAD);
+    if (header.signature == GPT_SIGNATURE) {
+      spi_flash_read_mode = SPI_FLASH_READ_QUAD;
     }
   }
-  return gpt_invalid_partition_range();
+#endif
 }
 
+#endif
 
-static int decode_sd_copy_error(int error)
+
+static int initialize_boot_device(void)
+{
+  int error = 0;
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD
+  error = initialize_sd((spi_ctrl*) SPI_CTRL_ADDR);
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SPI_FLASH
+  initialize_spi_flash((spi_ctrl*) SPI_CTRL_ADDR);
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_MMAP_FLASH || UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_RAMDISK
+  // Nothing to bring up
+#else
+  error = ERROR_CODE_UNHANDLED_SPI_DEVICE;
+#endif
+#if defined(UX00BOOT_SPI_IRQ) && UX00BOOT_BOOT_STAGE > 0 && \
+  (UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD || UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SPI_FLASH)
+  if (!error) spi_irq_enable((spi_ctrl*) SPI_CTRL_ADDR);
+#endif
+  return error;
+}
+
+
+#if UX00BOOT_BOOT_STAGE > 0
+
+//------------------------------------------------------------------------------
+// Block device
+//
+// The fsbl reads the boot device through a blockdev with a small read-ahead
+// cache. The ZSBL has to fit in the mask ROM and copies directly instead, see
+// below.
+//------------------------------------------------------------------------------
+
+static blockdev boot_dev;
+static blockdev_cache boot_cache;
+static uint8_t boot_cache_buf[UX00BOOT_CACHE_BLOCKS * GPT_BLOCK_SIZE] __attribute__((aligned(8)));
+
+
+// The backends below already return ERROR_CODE_* values; only the block
+// layer's own errors need translating
+static int decode_blockdev_error(int error)
 {
   switch (error) {
-    case SD_COPY_ERROR_CMD18: return ERROR_CODE_SD_CARD_CMD18;
-    case SD_COPY_ERROR_CMD18_CRC: return ERROR_CODE_SD_CARD_CMD18_CRC;
-    default: return ERROR_CODE_SD_CARD_UNEXPECTED_ERROR;
+    case BLOCKDEV_ERROR_RANGE: return ERROR_CODE_BLOCK_OUT_OF_RANGE;
+    default: return error;
   }
 }
 
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD
+
+//------------------------------------------------------------------------------
+// SD card block CRC offload
+//
+// Hart 0 only receives blocks and publishes the CRC the card sent for each
+// one. Secondary harts verify them behind it, each taking every num_workers-th
+// block, and report mismatches. Hart 0 then re-reads just the failed blocks.
 
-static int load_sd_gpt_partition(spi_ctrl* spictrl, void* dst, const gpt_guid* partition_type_guid)
+typedef struct
 {
-  uint8_t gpt_buf[GPT_BLOCK_SIZE];
-  int error;
-  error = sd_copy(spictrl, gpt_buf, GPT_HEADER_LBA, 1);
-  if (error) return decode_sd_copy_error(error);
+  volatile uint8_t* dst;
+  size_t num_blocks;
+  int num_workers;
+  _Atomic volatile size_t published;
+  _Atomic volatile size_t next[NUM_CORES];  // next block each worker checks
+  uint16_t crc[SD_CRC_RING_SIZE];
+  _Atomic volatile int num_bad;
+  size_t bad[SD_MAX_BAD_BLOCKS];
+} sd_crc_offload;
 
-  gpt_partition_range part_range;
-  {
-    // header will be overwritten by find_sd_gpt_partition(), so locally
-    // scope it.
-    gpt_header* header = (gpt_header*) gpt_buf;
-    part_range = find_sd_gpt_partition(
-      spictrl,
-      header->partition_entries_lba,
-      header->num_partition_entries,
-      header->partition_entry_size,
-      partition_type_guid,
-      gpt_buf
-    );
+static sd_crc_offload crc_offload;
+
+
+static void verify_sd_blocks(void* arg, int worker, int num_workers)
+{
+  sd_crc_offload* o = (sd_crc_offload*) arg;
+  for (size_t i = worker; i < o->num_blocks; i += num_workers) {
+    while (atomic_load(&o->published) <= i) ;
+    uint16_t crc = sd_crc16(0, (const void*) (o->dst + i * GPT_BLOCK_SIZE), GPT_BLOCK_SIZE);
+    if (crc != o->crc[i % SD_CRC_RING_SIZE]) {
+      int n = atomic_fetch_add(&o->num_bad, 1);
+      if (n < SD_MAX_BAD_BLOCKS) {
+        o->bad[n] = i;
+      }
+    }
+    atomic_store(&o->next[worker], i + num_workers);
   }
+}
 
-  if (!gpt_is_valid_partition_range(part_range)) {
-    return ERROR_CODE_GPT_PARTITION_NOT_FOUND;
+
+static int publish_sd_block(void* ctx, size_t block, const void* data, uint16_t crc)
+{
+  sd_crc_offload* o = (sd_crc_offload*) ctx;
+  // Don't overwrite a ring slot until the block that last used it is checked
+  if (block >= SD_CRC_RING_SIZE) {
+    for (int w = 0; w < o->num_workers; w++) {
+      while (atomic_load(&o->next[w]) <= block - SD_CRC_RING_SIZE) ;
+    }
+  }
+  o->crc[block % SD_CRC_RING_SIZE] = crc;
+  atomic_store(&o->published, block + 1);
+  return SD_BLOCK_CONTINUE;
+}
+
+
+/**
+ * Copy blocks from SD, verifying their CRCs on secondary harts if any are
+ * waiting for work and inline otherwise.
+ */
+static int copy_sd_blocks(spi_ctrl* spictrl, void* dst, uint64_t lba, size_t num_blocks)
+{
+  sd_crc_offload* o = &crc_offload;
+  if (hartjob_num_workers() == 0) {
+    return sd_copy(spictrl, dst, lba, num_blocks);
+  }
+
+  o->dst = dst;
+  o->num_blocks = num_blocks;
+  atomic_store(&o->published, 0);
+  atomic_store(&o->num_bad, 0);
+  for (int w = 0; w < NUM_CORES; w++) {
+    atomic_store(&o->next[w], w);
+  }
+  o->num_workers = hartjob_start(verify_sd_blocks, o);
+
+  int error = sd_copy_stream(spictrl, dst, lba, num_blocks, publish_sd_block, o);
+  // Let the workers run off the end even if the transfer stopped short
+  atomic_store(&o->published, num_blocks);
+  if (o->num_workers) hartjob_wait();
+  if (error) return error;
+
+  // Blocks past a short transfer would count as bad too, so only now
+  int num_bad = atomic_load(&o->num_bad);
+  sd_copy_crc_retries += num_bad;
+  if (num_bad > SD_MAX_BAD_BLOCKS) {
+    return sd_copy(spictrl, dst, lba, num_blocks);
+  }
+  for (int n = 0; n < num_bad; n++) {
+    size_t i = o->bad[n];
+    error = sd_copy(spictrl, (void*) (o->dst + i * GPT_BLOCK_SIZE), lba + i, 1);
+    if (error) return error;
+  }
+  return 0;
+}
+
+
+typedef struct
+{
+  blockdev_block_fn on_block;
+  void* ctx;
+} sd_stream_hook;
+
+
+// Blocks are only handed on once their CRC checks out
+static int check_sd_block(void* ctx, size_t block, const void* data, uint16_t crc)
+{
+  sd_stream_hook* hook = (sd_stream_hook*) ctx;
+  if (sd_crc16(0, data, GPT_BLOCK_SIZE) != crc) {
+    return SD_BLOCK_BAD_CRC;
   }
+  return hook->on_block(hook->ctx, block, data) == BLOCKDEV_BLOCK_STOP ? SD_BLOCK_STOP : SD_BLOCK_CONTINUE;
+}
+
 
-  error = sd_copy(
-    spictrl,
-    dst,
-    part_range.first_lba,
-    part_range.last_lba + 1 - part_range.first_lba
+static int read_sd_blocks(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks)
+{
+  int error = copy_sd_blocks((spi_ctrl*) dev->priv, dst, lba, num_blocks);
+  return error ? decode_sd_copy_error(error) : 0;
+}
+
+
+static int read_sd_stream(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks,
+                          blockdev_block_fn on_block, void* ctx)
+{
+  sd_stream_hook hook = { .on_block = on_block, .ctx = ctx };
+  int error = sd_copy_stream((spi_ctrl*) dev->priv, dst, lba, num_blocks, check_sd_block, &hook);
+  return error ? decode_sd_copy_error(error) : 0;
+}
+
+
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SPI_FLASH
+
+static int read_spi_flash_blocks(blockdev* dev, void* dst, uint64_t lba, size_t num_blocks)
+{
+  int error = spi_copy_mode(
+    (spi_ctrl*) dev->priv, dst, lba * GPT_BLOCK_SIZE, num_blocks * GPT_BLOCK_SIZE, spi_flash_read_mode
   );
-  if (error) return decode_sd_copy_error(error);
-  uart_puts((void*)UART0_CTRL_ADDR, "SD Load Partition Complete!\n\r");
+  return error ? ERROR_CODE_SPI_COPY_FAILED : 0;
+}
+
+#endif
+
+
+static int open_boot_device(blockdev* dev)
+{
+  int error = initialize_boot_device();
+  if (error) return error;
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD
+  dev->block_size = GPT_BLOCK_SIZE;
+  dev->caps = BLOCKDEV_CAP_STREAM;
+  dev->num_blocks = 0;
+  dev->read_blocks = read_sd_blocks;
+  dev->read_stream = read_sd_stream;
+  dev->mmap_base = NULL;
+  dev->priv = (void*) SPI_CTRL_ADDR;
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SPI_FLASH
+  dev->block_size = GPT_BLOCK_SIZE;
+  dev->caps = 0;
+  dev->num_blocks = SPI_MEM_SIZE / GPT_BLOCK_SIZE;
+  dev->read_blocks = read_spi_flash_blocks;
+  dev->read_stream = NULL;
+  dev->mmap_base = NULL;
+  dev->priv = (void*) SPI_CTRL_ADDR;
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_MMAP_FLASH
+  // Needs a controller that maps the flash at SPI_MEM_ADDR
+  blockdev_init_memory(dev, (const void*) SPI_MEM_ADDR, GPT_BLOCK_SIZE, SPI_MEM_SIZE / GPT_BLOCK_SIZE);
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_RAMDISK
+  blockdev_init_memory(dev, (const void*) UX00BOOT_RAMDISK_ADDR, GPT_BLOCK_SIZE, UX00BOOT_RAMDISK_BLOCKS);
+#endif
+  blockdev_cache_init(&boot_cache, dev, boot_cache_buf, UX00BOOT_CACHE_BLOCKS);
   return 0;
 }
 
 
 //------------------------------------------------------------------------------
-// SPI flash
+// GPT
 //------------------------------------------------------------------------------
 
-/**
- * Set up SPI for direct, non-memory-mapped access.
- *
-static inline int initialize_spi_flash_direct(spi_ctrl* spictrl, unsigned int spi_clk_input_khz)
+static uint8_t gpt_entries_scratch[GPT_ENTRIES_SCRATCH_BLOCKS * GPT_BLOCK_SIZE] __attribute__((aligned(8)));
+
+typedef struct
 {
-  // Max desired SPI clock is 10MHz
-  spictrl->sckdiv = spi_min_clk_divisor(spi_clk_input_khz, 10000);
+  const gpt_guid* const* partition_type_guids;
+  gpt_partition_range* ranges;
+  uint32_t num_guids;
+  uint32_t num_found;
+  uint32_t entries_per_block;
+} gpt_entry_scan;
 
-  spictrl->fctrl.en = 0;
 
-  spi_txrx(spictrl, MICRON_SPI_FLASH_CMD_RESET_ENABLE);
-  spi_txrx(spictrl, MICRON_SPI_FLASH_CMD_MEMORY_RESET);
+static int scan_gpt_block(void* ctx, size_t block, const void* data)
+{
+  gpt_entry_scan* scan = (gpt_entry_scan*) ctx;
+  scan->num_found = gpt_find_partitions_by_guid(
+    data, scan->entries_per_block,
+    scan->partition_type_guids, scan->ranges, scan->num_guids
+  );
+  return scan->num_found == scan->num_guids ? BLOCKDEV_BLOCK_STOP : BLOCKDEV_BLOCK_CONTINUE;
+}
 
-  return 0;
+
+/**
+ * Stream the partition entry array in as few transfers as possible, resolving
+ * every requested partition type in one pass and stopping as soon as all have
+ * been found. Returns how many were found.
+ */
+static uint32_t find_gpt_partitions(
+  blockdev* dev,
+  uint64_t partition_entries_lba,
+  uint32_t num_partition_entries,
+  uint32_t partition_entry_size,
+  const gpt_guid* const* partition_type_guids,
+  gpt_partition_range* ranges,
+  uint32_t num_guids
+)
+{
+  gpt_entry_scan scan = {
+    .partition_type_guids = partition_type_guids,
+    .ranges = ranges,
+    .num_guids = num_guids,
+    .num_found = 0,
+    .entries_per_block = GPT_BLOCK_SIZE / partition_entry_size,
+  };
+  for (uint32_t g = 0; g < num_guids; g++) {
+    ranges[g] = gpt_invalid_partition_range();
+  }
+  // Exclusive end
+  uint64_t partition_entries_lba_end = (
+    partition_entries_lba +
+    ((uint64_t) num_partition_entries * partition_entry_size + GPT_BLOCK_SIZE - 1) / GPT_BLOCK_SIZE
+  );
+  for (uint64_t i = partition_entries_lba; i < partition_entries_lba_end; i += GPT_ENTRIES_SCRATCH_BLOCKS) {
+    uint64_t num_blocks = partition_entries_lba_end - i;
+    if (num_blocks > GPT_ENTRIES_SCRATCH_BLOCKS) {
+      num_blocks = GPT_ENTRIES_SCRATCH_BLOCKS;
+    }
+    if (blockdev_read_stream(dev, gpt_entries_scratch, i, num_blocks, scan_gpt_block, &scan)) {
+      break;
+    }
+    if (scan.num_found == num_guids) {
+      break;
+    }
+  }
+  return scan.num_found;
 }
 
 
-static inline int _initialize_spi_flash_mmap(spi_ctrl* spictrl, unsigned int spi_clk_input_khz, unsigned int pad_cnt, unsigned int data_proto, unsigned int command_code)
+//------------------------------------------------------------------------------
+// Streaming LZ4 decompression
+//
+// Hart 0 streams the compressed image into a staging area and publishes how
+// much of it has arrived; the first secondary hart decompresses behind it
+// into the destination, so decompression costs nothing beyond the transfer.
+
+typedef struct
 {
-  // Max desired SPI clock is 10MHz
-  spictrl->sckdiv = spi_min_clk_divisor(spi_clk_input_khz, 10000);
+  const uint8_t* staging;
+  size_t staged_size;
+  _Atomic volatile size_t published;  // bytes of staging that have arrived
+  size_t src_size;
+  void* dst;
+  size_t dst_size;
+  size_t dst_len;
+  int error;
+} lz4_stream;
 
-  spictrl->fctrl.en = 0;
+static lz4_stream lz4_job;
 
-  spi_txrx(spictrl, MICRON_SPI_FLASH_CMD_RESET_ENABLE);
-  spi_txrx(spictrl, MICRON_SPI_FLASH_CMD_MEMORY_RESET);
 
-  spictrl->ffmt.raw_bits = ((spi_reg_ffmt) {
-    .cmd_en = 1,
-    .addr_len = 3,
-    .pad_cnt = pad_cnt,
-    .command_proto = SPI_PROTO_S,
-    .addr_proto = SPI_PROTO_S,
-    .data_proto = data_proto,
-    .command_code = command_code,
-  }).raw_bits;
+static size_t wait_lz4_input(void* ctx, size_t needed)
+{
+  lz4_stream* s = (lz4_stream*) ctx;
+  size_t avail;
+  while ((avail = atomic_load(&s->published)) < needed && avail < s->staged_size) ;
+  return avail;
+}
 
-  spictrl->fctrl.en = 1;
-  __asm__ __volatile__ ("fence io, io");
-  return 0;
+
+static void decompress_lz4_stream(void* arg, int worker, int num_workers)
+{
+  lz4_stream* s = (lz4_stream*) arg;
+  if (worker != 0) return;
+  s->error = lz4_decompress(s->dst, s->dst_size, &s->dst_len, s->staging, s->src_size, wait_lz4_input, s);
 }
 
 
-static int initialize_spi_flash_mmap_single(spi_ctrl* spictrl, unsigned int spi_clk_input_khz)
+static int publish_lz4_block(void* ctx, size_t block, const void* data)
 {
-  return _initialize_spi_flash_mmap(spictrl, spi_clk_input_khz, 0, SPI_PROTO_S, MICRON_SPI_FLASH_CMD_READ);
+  lz4_stream* s = (lz4_stream*) ctx;
+  atomic_store(&s->published, (block + 1) * GPT_BLOCK_SIZE);
+  return BLOCKDEV_BLOCK_CONTINUE;
 }
 
 
-static int initialize_spi_flash_mmap_quad(spi_ctrl* spictrl, unsigned int spi_clk_input_khz)
+static int load_lz4_image(void* dst, size_t dst_size, uint64_t lba, size_t image_size, size_t load_size)
 {
-  return _initialize_spi_flash_mmap(spictrl, spi_clk_input_khz, 8, SPI_PROTO_Q, MICRON_SPI_FLASH_CMD_QUAD_FAST_READ);
+  lz4_stream* s = &lz4_job;
+  size_t num_blocks = (image_size + GPT_BLOCK_SIZE - 1) / GPT_BLOCK_SIZE;
+  size_t staging_offset = (load_size + LZ4_STAGING_ALIGN - 1) & ~(LZ4_STAGING_ALIGN - 1);
+  int error;
+
+  // The compressed blocks have to fit after the image in the destination too
+  if (staging_offset < load_size || staging_offset > dst_size ||
+      num_blocks * GPT_BLOCK_SIZE > dst_size - staging_offset) {
+    return ERROR_CODE_IMAGE_TOO_LARGE;
+  }
+  s->staging = (const uint8_t*) dst + staging_offset;
+  s->staged_size = num_blocks * GPT_BLOCK_SIZE;
+  atomic_store(&s->published, 0);
+  s->src_size = image_size;
+  s->dst = dst;
+  s->dst_size = load_size;
+  s->dst_len = 0;
+  s->error = 0;
+
+  if (hartjob_start(decompress_lz4_stream, s) == 0) {
+    error = blockdev_read(&boot_cache, (void*) s->staging, lba, num_blocks);
+    if (error) return error;
+    s->error = lz4_decompress(dst, load_size, &s->dst_len, s->staging, image_size, NULL, NULL);
+  } else {
+    error = blockdev_read_stream(&boot_dev, (void*) s->staging, lba, num_blocks, publish_lz4_block, s);
+    // Let the decompressor run off the end even if the transfer stopped short
+    atomic_store(&s->published, s->staged_size);
+    hartjob_wait();
+    if (error) return error;
+  }
+
+  if (s->error || s->dst_len != load_size) {
+    return ERROR_CODE_IMAGE_DECOMPRESS;
+  }
+  return 0;
 }
 
 
 //------------------------------------------------------------------------------
-// SPI flash memory-mapped
+// ELF loading
+//
+// Only the file ranges of PT_LOAD segments are read, each straight to its
+// physical address, and the rest of each segment is zeroed locally instead of
+// crossing the SPI bus.
 
-static gpt_partition_range find_mmap_gpt_partition(const void* gpt_base, const gpt_guid* partition_type_guid)
+static elf64_phdr elf_phdrs[ELF_MAX_PHDRS];
+
+// A .bss tail left on the DMA engine
+typedef struct {
+  uint8_t* dst;
+  size_t len;
+} bss_clear;
+
+
+static void start_bss_clear(bss_clear* c, uint8_t* dst, size_t len)
 {
-  gpt_header* header = (gpt_header*) ((uintptr_t) gpt_base + GPT_HEADER_LBA * GPT_BLOCK_SIZE);
-  gpt_partition_range range;
-  range = gpt_find_partition_by_guid(
-    (const void*) ((uintptr_t) gpt_base + header->partition_entries_lba * GPT_BLOCK_SIZE),
-    partition_type_guid,
-    header->num_partition_entries
-  );
-  if (gpt_is_valid_partition_range(range)) {
-    return range;
+  if (len < DMA_MIN_BYTES || len > CACHEABLE_ZERO_MEM_SIZE ||
+      dma_submit_zero(DMA_CHANNEL_CLEAR, dst, len)) {
+    memset(dst, 0, len);
+    return;
   }
-  return gpt_invalid_partition_range();
+  c->dst = dst;
+  c->len = len;
+}
+
+
+static void finish_bss_clear(bss_clear* c)
+{
+  if (c->len && dma_wait(DMA_CHANNEL_CLEAR)) {
+    memset(c->dst, 0, c->len);
+  }
+  c->len = 0;
+}
+
+
+/**
+ * Scatter-load the PT_LOAD segments of the ELF executable whose first block
+ * is ehdr. The fsbl enters the payload at dst, so the entry point has to be
+ * there, and every segment has to fit in the dst_size bytes from dst.
+ */
+static int load_elf(void* dst, size_t dst_size, gpt_partition_range range, const elf64_ehdr* ehdr)
+{
+  uint64_t part_offset = range.first_lba * GPT_BLOCK_SIZE;
+  uint64_t part_size = (range.last_lba + 1 - range.first_lba) * GPT_BLOCK_SIZE;
+  uint64_t phoff = ehdr->e_phoff;
+  uint16_t phnum = ehdr->e_phnum;
+  size_t phdrs_size = phnum * sizeof(elf64_phdr);
+  bss_clear clear = { NULL, 0 };
+  int error = 0;
+
+  if (ehdr->e_entry != (uintptr_t) dst) {
+    return ERROR_CODE_ELF_ENTRY;
+  }
+  if (phnum > ELF_MAX_PHDRS) {
+    return ERROR_CODE_ELF_TOO_MANY_SEGMENTS;
+  }
+  // Bounds are checked as differences so nothing a header holds can wrap
+  if (phoff > part_size || phdrs_size > part_size - phoff) {
+    return ERROR_CODE_IMAGE_TOO_LARGE;
+  }
+  // ehdr points into the cache, which the segment reads below may refill
+  error = blockdev_read_bytes(&boot_cache, elf_phdrs, part_offset + phoff, phdrs_size);
+  if (error) return error;
+
+  for (uint16_t i = 0; i < phnum; i++) {
+    const elf64_phdr* ph = &elf_phdrs[i];
+    if (ph->p_type != ELF_PT_LOAD) continue;
+    if (ph->p_filesz > ph->p_memsz ||
+        ph->p_offset > part_size || ph->p_filesz > part_size - ph->p_offset) {
+      error = ERROR_CODE_IMAGE_TOO_LARGE;
+      break;
+    }
+    if (ph->p_paddr < (uintptr_t) dst ||
+        ph->p_paddr - (uintptr_t) dst > dst_size ||
+        ph->p_memsz > dst_size - (ph->p_paddr - (uintptr_t) dst)) {
+      error = ERROR_CODE_IMAGE_LOAD_ADDR;
+      break;
+    }
+    uint8_t* seg = (uint8_t*) ph->p_paddr;
+    error = blockdev_read_bytes(&boot_cache, seg, part_offset + ph->p_offset, ph->p_filesz);
+    if (error) break;
+    // Spread the clear over the secondary harts while they wait for work, or
+    // leave it to the DMA engine while the next segment is read
+    uint8_t* bss = seg + ph->p_filesz;
+    size_t bss_size = ph->p_memsz - ph->p_filesz;
+    if (hartjob_num_workers()) {
+      hartjob_memset(bss, 0, bss_size);
+    } else {
+      finish_bss_clear(&clear);
+      start_bss_clear(&clear, bss, bss_size);
+    }
+  }
+  finish_bss_clear(&clear);
+  return error;
 }
 
 
+
 /**
- * Load GPT partition from memory-mapped GPT image.
+ * Load a partition, or only the image inside it if it starts with a
+ * ux00boot_image_header, or only the loadable segments if it holds an ELF
+ * executable.
  *
-static int load_mmap_gpt_partition(const void* gpt_base, void* payload_dest, const gpt_guid* partition_type_guid)
+ * The first block comes through the read-ahead cache, so the blocks after it
+ * are usually already at hand whichever way the partition is loaded.
+ */
+static int load_image(void* dst, size_t dst_size, gpt_partition_range range)
+{
+  uint64_t num_blocks = range.last_lba + 1 - range.first_lba;
+  const uint8_t* first_block;
+  int error;
+  error = blockdev_cache_get(&boot_cache, range.first_lba, &first_block);
+  if (error) return error;
+
+  const ux00boot_image_header* header = (const ux00boot_image_header*) first_block;
+  if (header->magic != UX00BOOT_IMAGE_MAGIC) {
+    if (elf_is_riscv64_exec((const elf64_ehdr*) first_block)) {
+      return load_elf(dst, dst_size, range, (const elf64_ehdr*) first_block);
+    }
+    if (num_blocks > dst_size / GPT_BLOCK_SIZE) {
+      return ERROR_CODE_IMAGE_TOO_LARGE;
+    }
+    return blockdev_read(&boot_cache, dst, range.first_lba, num_blocks);
+  }
+
+  uint64_t image_size = header->image_size;
+  uint64_t image_blocks = (image_size + GPT_BLOCK_SIZE - 1) / GPT_BLOCK_SIZE;
+  uint16_t image_crc = header->image_crc;
+  uint32_t flags = header->flags;
+  uint64_t load_size = (flags & UX00BOOT_IMAGE_FLAG_LZ4) ? header->load_size : image_size;
+  // Later formats may change what the fields mean, so don't guess
+  if (header->version != UX00BOOT_IMAGE_VERSION || (flags & ~UX00BOOT_IMAGE_FLAG_LZ4) ||
+      header->reserved0 || header->reserved1[0] || header->reserved1[1] || header->reserved1[2]) {
+    return ERROR_CODE_IMAGE_UNSUPPORTED;
+  }
+  if (image_blocks > num_blocks - 1 || load_size > dst_size ||
+      (!(flags & UX00BOOT_IMAGE_FLAG_LZ4) && image_blocks > dst_size / GPT_BLOCK_SIZE)) {
+    return ERROR_CODE_IMAGE_TOO_LARGE;
+  }
+  if (flags & UX00BOOT_IMAGE_FLAG_LZ4) {
+    error = load_lz4_image(dst, dst_size, range.first_lba + 1, image_size, load_size);
+    if (error) return error;
+  } else if (image_blocks > 0) {
+    error = blockdev_read(&boot_cache, dst, range.first_lba + 1, image_blocks);
+    if (error) return error;
+  }
+  if (sd_crc16(0, dst, load_size) != image_crc) {
+    return ERROR_CODE_IMAGE_CHECKSUM;
+  }
+  return 0;
+}
+
+
+static int find_partitions(
+  ux00boot_gpt_lookup* lookup,
+  const gpt_guid* const* partition_type_guids,
+  uint32_t num_partitions
+)
 {
-  gpt_partition_range range = find_mmap_gpt_partition(gpt_base, partition_type_guid);
-  if (!gpt_is_valid_partition_range(range)) {
+  const uint8_t* gpt_block;
+  int error;
+  if (num_partitions > UX00BOOT_MAX_PARTITIONS) {
+    return ERROR_CODE_TOO_MANY_PARTITIONS;
+  }
+  // The entries are streamed separately, so read-ahead past the header would
+  // only be thrown away
+  error = blockdev_cache_get_single(&boot_cache, GPT_HEADER_LBA, &gpt_block);
+  if (error) return decode_blockdev_error(error);
+
+  uint32_t num_found;
+  {
+    const gpt_header* header = (const gpt_header*) gpt_block;
+    if (!gpt_is_valid_header(header)) {
+      return ERROR_CODE_GPT_INVALID_HEADER;
+    }
+    num_found = find_gpt_partitions(
+      &boot_dev,
+      header->partition_entries_lba,
+      header->num_partition_entries,
+      header->partition_entry_size,
+      partition_type_guids,
+      lookup->ranges,
+      num_partitions
+    );
+  }
+
+  if (num_found != num_partitions) {
     return ERROR_CODE_GPT_PARTITION_NOT_FOUND;
   }
-  memcpy(
-    payload_dest,
-    (void*) ((uintptr_t) gpt_base + range.first_lba * GPT_BLOCK_SIZE),
-    (range.last_lba + 1 - range.first_lba) * GPT_BLOCK_SIZE
-  );
+  lookup->num_partitions = num_partitions;
+  return 0;
+}
+
+
+static int load_partitions(const ux00boot_gpt_lookup* lookup, void* const* dsts, const size_t* dst_sizes)
+{
+  int error;
+  for (uint32_t i = 0; i < lookup->num_partitions; i++) {
+    error = load_image(dsts[i], dst_sizes[i], lookup->ranges[i]);
+    if (error) return decode_blockdev_error(error);
+  }
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD
+  if (sd_copy_crc_retries) {
+    uart_puts((void*)UART0_CTRL_ADDR, "SD CRC retries: 0x");
+    uart_put_hex((void*)UART0_CTRL_ADDR, sd_copy_crc_retries);
+    uart_puts((void*)UART0_CTRL_ADDR, "\n\r");
+  }
+  uart_puts((void*)UART0_CTRL_ADDR, "SD Load Partition Complete!\n\r");
+#else
+  uart_puts((void*)UART0_CTRL_ADDR, "Load Partition Complete!\n\r");
+#endif
   return 0;
 }
 
 
+static void finish_boot_device(void)
+{
+#if defined(UX00BOOT_SPI_IRQ) && \
+  (UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD || UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SPI_FLASH)
+  // Leave the PLIC and mie as the payload expects to find them
+  spi_irq_disable((spi_ctrl*) SPI_CTRL_ADDR);
+#endif
+}
+
+#else
+
+//------------------------------------------------------------------------------
+// ZSBL direct copy
+//
+// The ZSBL has to fit in the 8 KiB mask ROM, so the block-device layer, its
+// read-ahead cache and the image, LZ4 and ELF loaders stay in the fsbl. The
+// GPT is scanned a block at a time and the whole partition is copied straight
+// off the boot device.
 //------------------------------------------------------------------------------
-// SPI flash non-memory-mapped
 
-static gpt_partition_range find_spiflash_gpt_partition(
-  spi_ctrl* spictrl,
+static int copy_blocks(void* dst, uint64_t lba, size_t num_blocks)
+{
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD
+  int error = sd_copy((spi_ctrl*) SPI_CTRL_ADDR, dst, lba, num_blocks);
+  return error ? decode_sd_copy_error(error) : 0;
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SPI_FLASH
+  int error = spi_copy_mode(
+    (spi_ctrl*) SPI_CTRL_ADDR, dst, lba * GPT_BLOCK_SIZE, num_blocks * GPT_BLOCK_SIZE, spi_flash_read_mode
+  );
+  return error ? ERROR_CODE_SPI_COPY_FAILED : 0;
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_MMAP_FLASH
+  memcpy(dst, (const void*) (SPI_MEM_ADDR + lba * GPT_BLOCK_SIZE), num_blocks * GPT_BLOCK_SIZE);
+  return 0;
+#elif UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_RAMDISK
+  memcpy(dst, (const void*) (UX00BOOT_RAMDISK_ADDR + lba * GPT_BLOCK_SIZE), num_blocks * GPT_BLOCK_SIZE);
+  return 0;
+#else
+  return ERROR_CODE_UNHANDLED_SPI_DEVICE;
+#endif
+}
+
+
+static gpt_partition_range find_gpt_partition(
   uint64_t partition_entries_lba,
   uint32_t num_partition_entries,
   uint32_t partition_entry_size,
   const gpt_guid* partition_type_guid,
-  void* block_buf  // Used to temporarily load blocks of SD card
+  void* block_buf  // Used to temporarily load blocks of the boot device
 )
 {
   // Exclusive end
   uint64_t partition_entries_lba_end = (
     partition_entries_lba +
-    (num_partition_entries * partition_entry_size + GPT_BLOCK_SIZE - 1) / GPT_BLOCK_SIZE
+    ((uint64_t) num_partition_entries * partition_entry_size + GPT_BLOCK_SIZE - 1) / GPT_BLOCK_SIZE
   );
   for (uint64_t i = partition_entries_lba; i < partition_entries_lba_end; i++) {
-    spi_copy(spictrl, block_buf, i * GPT_BLOCK_SIZE, GPT_BLOCK_SIZE);
+    if (copy_blocks(block_buf, i, 1)) break;
     gpt_partition_range range = gpt_find_partition_by_guid(
       block_buf, partition_type_guid, GPT_BLOCK_SIZE / partition_entry_size
     );
@@ -271,21 +845,21 @@ static gpt_partition_range find_spiflash_gpt_partition(
 }
 
 
-/**
- * Load GPT partition from SPI flash.
- *
-static int load_spiflash_gpt_partition(spi_ctrl* spictrl, void* dst, const gpt_guid* partition_type_guid)
+static int load_gpt_partition(void* dst, const gpt_guid* partition_type_guid)
 {
-  uint8_t gpt_buf[GPT_BLOCK_SIZE];
+  uint8_t gpt_buf[GPT_BLOCK_SIZE] __attribute__((aligned(8)));
   int error;
-  error = spi_copy(spictrl, gpt_buf, GPT_HEADER_LBA * GPT_BLOCK_SIZE, GPT_HEADER_BYTES);
-  if (error) return ERROR_CODE_SPI_COPY_FAILED;
+  error = copy_blocks(gpt_buf, GPT_HEADER_LBA, 1);
+  if (error) return error;
 
   gpt_partition_range part_range;
   {
+    // header will be overwritten by find_gpt_partition(), so locally scope it.
     gpt_header* header = (gpt_header*) gpt_buf;
-    part_range = find_spiflash_gpt_partition(
-      spictrl,
+    if (!gpt_is_valid_header(header)) {
+      return ERROR_CODE_GPT_INVALID_HEADER;
+    }
+    part_range = find_gpt_partition(
       header->partition_entries_lba,
       header->num_partition_entries,
       header->partition_entry_size,
@@ -298,16 +872,17 @@ static int load_spiflash_gpt_partition(spi_ctrl* spictrl, void* dst, const gpt_g
     return ERROR_CODE_GPT_PARTITION_NOT_FOUND;
   }
 
-  error = spi_copy(
-    spictrl,
-    dst,
-    part_range.first_lba * GPT_BLOCK_SIZE,
-    (part_range.last_lba + 1 - part_range.first_lba) * GPT_BLOCK_SIZE
-  );
-  if (error) return ERROR_CODE_SPI_COPY_FAILED;
+  error = copy_blocks(dst, part_range.first_lba, part_range.last_lba + 1 - part_range.first_lba);
+  if (error) return error;
+#if UX00BOOT_BOOT_DEVICE == UX00BOOT_DEVICE_SD
+  uart_puts((void*)UART0_CTRL_ADDR, "SD Load Partition Complete!\n\r");
+#else
+  uart_puts((void*)UART0_CTRL_ADDR, "Load Partition Complete!\n\r");
+#endif
   return 0;
 }
-*/
+
+#endif
 
 
 void ux00boot_fail(long code, int trap)
@@ -361,13 +936,94 @@ void ux00boot_fail(long code, int trap)
  */
 void ux00boot_load_gpt_partition(void* dst, const gpt_guid* partition_type_guid)
 {
+#if UX00BOOT_BOOT_STAGE > 0
+  // No bound on the destination is known here
+  size_t dst_size = SIZE_MAX;
+  ux00boot_load_gpt_partitions(&dst, &dst_size, &partition_type_guid, 1);
+#else
+  unsigned int error = initialize_boot_device();
+  if (!error) error = load_gpt_partition(dst, partition_type_guid);
 
-  spi_ctrl* spictrl = (spi_ctrl*) SPI_CTRL_ADDR;
-  unsigned int error = 0;
-  error = initialize_sd(spictrl);
-  if (!error) error = load_sd_gpt_partition(spictrl, dst, partition_type_guid);
+  if (error) {
+    ux00boot_fail(error, 0);
+  }
+#endif
+}
+
+
+#if UX00BOOT_BOOT_STAGE > 0
+
+/**
+ * Load several GPT partitions, each into its own destination, resolving all
+ * of them in a single walk of the partition entries. Nothing is written past
+ * the dst_sizes[i] bytes at dsts[i].
+ *
+ * Fails if any of the partition types is not present.
+ */
+void ux00boot_load_gpt_partitions(
+  void* const* dsts,
+  const size_t* dst_sizes,
+  const gpt_guid* const* partition_type_guids,
+  uint32_t num_partitions
+)
+{
+  ux00boot_gpt_lookup lookup;
+  unsigned int error = open_boot_device(&boot_dev);
+  if (!error) error = find_partitions(&lookup, partition_type_guids, num_partitions);
+  if (!error) error = load_partitions(&lookup, dsts, dst_sizes);
+  finish_boot_device();
 
   if (error) {
     ux00boot_fail(error, 0);
   }
 }
+
+
+/**
+ * First half of ux00boot_load_gpt_partitions(): bring up the boot device and
+ * resolve the partitions without touching any destination memory.
+ *
+ * Everything read here lands in buffers inside this program, so it can run
+ * before DDR is up. The first block of the first partition is read ahead so
+ * the load can start from the cache.
+ */
+void ux00boot_find_gpt_partitions(
+  ux00boot_gpt_lookup* lookup,
+  const gpt_guid* const* partition_type_guids,
+  uint32_t num_partitions
+)
+{
+  unsigned int error = open_boot_device(&boot_dev);
+  if (!error) error = find_partitions(lookup, partition_type_guids, num_partitions);
+  if (!error) {
+    const uint8_t* first_block;
+    // A failure here is retried, and reported, by the load
+    blockdev_cache_get(&boot_cache, lookup->ranges[0].first_lba, &first_block);
+  }
+
+  if (error) {
+    finish_boot_device();
+    ux00boot_fail(error, 0);
+  }
+}
+
+
+/**
+ * Second half of ux00boot_load_gpt_partitions(): load the partitions found by
+ * ux00boot_find_gpt_partitions(), in the same order, into dsts.
+ */
+void ux00boot_load_found_partitions(
+  const ux00boot_gpt_lookup* lookup,
+  void* const* dsts,
+  const size_t* dst_sizes
+)
+{
+  unsigned int error = load_partitions(lookup, dsts, dst_sizes);
+  finish_boot_device();
+
+  if (error) {
+    ux00boot_fail(error, 0);
+  }
+}
+
+#endif
@@ -10,7 +10,61 @@
 
 #include <gpt/gpt.h>
 
+// Most partitions ux00boot_load_gpt_partitions() resolves in one call
+#define UX00BOOT_MAX_PARTITIONS 4
+
+// "UX00IMG\0"
+#define UX00BOOT_IMAGE_MAGIC 0x00474d4930305855UL
+#define UX00BOOT_IMAGE_VERSION 1
+
+// The image is an LZ4 block and load_size is its decompressed size
+#define UX00BOOT_IMAGE_FLAG_LZ4 (1 << 0)
+
+/**
+ * Optional header in the first block of a partition. When present, only
+ * image_size bytes starting at the partition's second block are loaded
+ * instead of the whole partition. The image always goes to the destination
+ * the caller asks for. Reserved fields must be zero.
+ */
+typedef struct
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t flags;
+  uint64_t image_size;    // bytes stored in the partition
+  uint64_t reserved0;
+  uint16_t image_crc;     // CRC16-CCITT of the loaded bytes
+  uint16_t reserved1[3];
+  uint64_t load_size;     // bytes once decompressed, if compressed
+} ux00boot_image_header;
+
+/**
+ * Partitions resolved by ux00boot_find_gpt_partitions(), waiting to be loaded
+ * by ux00boot_load_found_partitions().
+ */
+typedef struct
+{
+  gpt_partition_range ranges[UX00BOOT_MAX_PARTITIONS];
+  uint32_t num_partitions;
+} ux00boot_gpt_lookup;
+
 void ux00boot_load_gpt_partition(void* dst, const gpt_guid* partition_type_guid);
+void ux00boot_load_gpt_partitions(
+  void* const* dsts,
+  const size_t* dst_sizes,
+  const gpt_guid* const* partition_type_guids,
+  uint32_t num_partitions
+);
+void ux00boot_find_gpt_partitions(
+  ux00boot_gpt_lookup* lookup,
+  const gpt_guid* const* partition_type_guids,
+  uint32_t num_partitions
+);
+void ux00boot_load_found_partitions(
+  const ux00boot_gpt_lookup* lookup,
+  void* const* dsts,
+  const size_t* dst_sizes
+);
 void ux00boot_fail(long code, int trap);
 
 #endif /* !__ASSEMBLER__ */